@@ -0,0 +1,624 @@
+#include "DualContouring.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Edge length, in finest cells, of the octree nodes sampled densely
+#define DC_BRICK_CELLS 8
+#define DC_MAX_DEPTH 10
+// Cosine of the largest angle between a normal of a flat leaf and their mean, about 15 degrees
+#define DC_FLAT_COS 0.966
+
+// Children and corners of a cell are numbered by their offset ((i >> 2) & 1, (i >> 1) & 1, i & 1).
+// Around an edge along axis d the four cells are ordered 2 * u + v, with (u, v) the
+// next two axes after d in cyclic order.
+static const int edgevmap[12][2] = {
+    {0,4}, {1,5}, {2,6}, {3,7},     // x axis
+    {0,2}, {1,3}, {4,6}, {5,7},     // y axis
+    {0,1}, {2,3}, {4,5}, {6,7}      // z axis
+};
+static const int cellProcFaceMask[12][3] = {
+    {0,4,0}, {1,5,0}, {2,6,0}, {3,7,0}, {0,2,1}, {4,6,1}, {1,3,1}, {5,7,1}, {0,1,2}, {2,3,2}, {4,5,2}, {6,7,2}
+};
+static const int cellProcEdgeMask[6][5] = {
+    {0,1,2,3,0}, {4,5,6,7,0}, {0,4,1,5,1}, {2,6,3,7,1}, {0,2,4,6,2}, {1,3,5,7,2}
+};
+static const int faceProcFaceMask[3][4][3] = {
+    {{4,0,0}, {5,1,0}, {6,2,0}, {7,3,0}},
+    {{2,0,1}, {6,4,1}, {3,1,1}, {7,5,1}},
+    {{1,0,2}, {3,2,2}, {5,4,2}, {7,6,2}}
+};
+static const int faceProcEdgeMask[3][4][6] = {
+    {{1,4,0,5,1,1}, {1,6,2,7,3,1}, {0,4,6,0,2,2}, {0,5,7,1,3,2}},
+    {{0,2,3,0,1,0}, {0,6,7,4,5,0}, {1,2,0,6,4,2}, {1,3,1,7,5,2}},
+    {{1,1,0,3,2,0}, {1,5,4,7,6,0}, {0,1,5,0,4,1}, {0,3,7,2,6,1}}
+};
+static const int faceProcOrders[2][4] = { {0,0,1,1}, {0,1,0,1} };
+static const int edgeProcEdgeMask[3][2][5] = {
+    {{3,2,1,0,0}, {7,6,5,4,0}},
+    {{5,1,4,0,1}, {7,3,6,2,1}},
+    {{6,4,2,0,2}, {7,5,3,1,2}}
+};
+static const int processEdgeMask[3][4] = { {3,2,1,0}, {7,5,6,4}, {11,10,9,8} };
+
+// Quadratic error function of the surface planes (point, normal) seen in a cell
+struct Qef {
+    Matrix<Real, 3, 3> ata = Matrix<Real, 3, 3>::Zero();
+    VEC3F atb = VEC3F::Zero();
+    Real btb = 0;
+    VEC3F massSum = VEC3F::Zero();
+    VEC3F normalSum = VEC3F::Zero();
+    int count = 0;
+
+    void add(const VEC3F& p, const VEC3F& n) {
+        Real d = n.dot(p);
+        ata += n * n.transpose();
+        atb += n * d;
+        btb += d * d;
+        massSum += p;
+        normalSum += n;
+        count++;
+    }
+
+    void add(const Qef& other) {
+        ata += other.ata;
+        atb += other.atb;
+        btb += other.btb;
+        massSum += other.massSum;
+        normalSum += other.normalSum;
+        count += other.count;
+    }
+
+    // Minimizer about the mass point, falling back to the mass point if it leaves the cell.
+    // error is the summed squared distance to the planes.
+    VEC3F solve(const VEC3F& cellMin, const VEC3F& cellMax, Real* error) const {
+        VEC3F mass = massSum / count;
+
+        // Truncated pseudo-inverse, so flat and edge-like cells stay near the mass point
+        SelfAdjointEigenSolver<Matrix<Real, 3, 3>> eigen(ata);
+        VEC3F lambda = eigen.eigenvalues();
+        Real cutoff = 0.05 * lambda.maxCoeff();
+        Matrix<Real, 3, 3> pinv = Matrix<Real, 3, 3>::Zero();
+        for (int i = 0; i < 3; ++i) {
+            if (lambda[i] > cutoff && lambda[i] > 0) {
+                VEC3F v = eigen.eigenvectors().col(i);
+                pinv += v * v.transpose() / lambda[i];
+            }
+        }
+        VEC3F x = mass + pinv * (atb - ata * mass);
+
+        VEC3F margin = (cellMax - cellMin) * 1e-3;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (x[axis] < cellMin[axis] - margin[axis] || x[axis] > cellMax[axis] + margin[axis]) {
+                x = mass;
+                break;
+            }
+        }
+
+        *error = std::max<Real>(0, x.dot(ata * x) - 2 * x.dot(atb) + btb);
+        return x;
+    }
+};
+
+enum DCNodeType { DC_INTERNAL, DC_LEAF, DC_EMPTY };
+
+struct DCNode {
+    DCNodeType type = DC_EMPTY;
+    int x = 0, y = 0, z = 0;    // min corner on the finest lattice
+    int size = 0;               // edge length in finest cells
+    int children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+    unsigned char corners = 0;  // bit i set when corner i is inside
+    Qef qef;                    // leaves only
+    VEC3F position = VEC3F::Zero();
+    int vertex = -1;
+};
+
+// Octree over a cube of 2^depth finest cells of side h starting at origin
+struct DCOctree {
+    std::vector<DCNode> nodes;
+    VEC3F origin;
+    Real h;
+
+    VEC3F latticePoint(Real x, Real y, Real z) const {
+        return origin + h * VEC3F(x, y, z);
+    }
+    VEC3F nodeMin(const DCNode& node) const {
+        return latticePoint(node.x, node.y, node.z);
+    }
+    VEC3F nodeMax(const DCNode& node) const {
+        return latticePoint(node.x + node.size, node.y + node.size, node.z + node.size);
+    }
+};
+
+static int childOffset(int child, int axis) {
+    return (child >> (2 - axis)) & 1;
+}
+
+// Outward surface normal of the field (positive inside), against its gradient
+static VEC3F fieldNormal(const JuliaSet& js, const VEC3F& p, size_t idx, size_t num_iter) {
+    VEC3F gradient;
+    js.queryFieldValueAndGradient(p, &gradient, idx, num_iter);
+    Real length = gradient.norm();
+    return length > 0 ? VEC3F(-gradient / length) : VEC3F(0, 0, 0);
+}
+
+// When buildBrick stops refining: the narrow band bounds of DualContouring, and the
+// distance a flat leaf may stray from the field
+struct DCRefinement {
+    Real perturbation, lipschitz, slack;
+    Real maxError;      // 0 refines every crossing to the finest cells
+};
+
+// Builds the subtree of a brick of finest cells into local, rooted at local[0].
+// Nodes are refined top down and the lattice is sampled on first use, so flat
+// regions stop early without visiting most of it.
+static void buildBrick(const DCOctree& tree, const DCNode& brick, const JuliaSet& js, size_t idx, size_t num_iter, const DCRefinement& refine, std::vector<DCNode>* local) {
+    const int B = brick.size;
+    const int S = B + 1;
+    auto sampleIndex = [S](int i, int j, int k) { return i + S * (j + S * k); };
+
+    std::vector<Real> values(static_cast<size_t>(S) * S * S, std::numeric_limits<Real>::quiet_NaN());
+    auto sample = [&](int i, int j, int k) {
+        Real& value = values[sampleIndex(i, j, k)];
+        if (std::isnan(value)) {
+            value = js.queryFieldValue(tree.latticePoint(brick.x + i, brick.y + j, brick.z + k), 4.0, idx, num_iter);
+        }
+        return value;
+    };
+
+    // Hermite data of every crossing finest edge, keyed by its lower sample and axis
+    // so neighbouring cells share one normal evaluation
+    std::vector<VEC3F> edgeNormals(3 * values.size());
+    std::vector<char> edgeDone(3 * values.size(), 0);
+
+    // A node above the finest level becomes a leaf when its 27 samples at the
+    // corners, edge and face midpoints and centre show a single flat sheet:
+    // - every midpoint shares its sign with a corner of its edge, face or cell, so
+    //   the children add no crossings the node cannot see (Ju et al. 2002, 4.2)
+    // - the corners' trilinear interpolation predicts every midpoint within maxError
+    // - the normals at the crossings of its edges stay within DC_FLAT_COS of their mean
+    // - their planes fit one vertex within maxError RMS, as in simplify
+    auto flatLeaf = [&](int x, int y, int z, int size, DCNode* node) {
+        if (!(refine.maxError > 0)) return false;
+        const int half = size / 2;
+        Real v[3][3][3];
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                for (int c = 0; c < 3; ++c) {
+                    v[a][b][c] = sample(x + a * half, y + b * half, z + c * half);
+                }
+            }
+        }
+
+        node->corners = 0;
+        for (int c = 0; c < 8; ++c) {
+            if (v[2 * childOffset(c, 0)][2 * childOffset(c, 1)][2 * childOffset(c, 2)] > 0) node->corners |= 1 << c;
+        }
+        if (node->corners == 0 || node->corners == 255) return false;
+
+        for (int a = 0; a < 3; ++a) {
+            for (int b = 0; b < 3; ++b) {
+                for (int c = 0; c < 3; ++c) {
+                    if (a != 1 && b != 1 && c != 1) continue;
+                    // The corners spanning this midpoint, whose mean is their trilinear value
+                    Real sum = 0;
+                    int count = 0;
+                    bool sameSign = false;
+                    for (int corner = 0; corner < 8; ++corner) {
+                        int ca = 2 * childOffset(corner, 0), cb = 2 * childOffset(corner, 1), cc = 2 * childOffset(corner, 2);
+                        if ((a != 1 && ca != a) || (b != 1 && cb != b) || (c != 1 && cc != c)) continue;
+                        sum += v[ca][cb][cc];
+                        count++;
+                        sameSign |= (v[ca][cb][cc] > 0) == (v[a][b][c] > 0);
+                    }
+                    if (!sameSign || std::abs(v[a][b][c] - sum / count) > refine.maxError) return false;
+                }
+            }
+        }
+
+        // Crossings on the half of each edge where the sign changes
+        VEC3F points[12], normals[12];
+        int crossings = 0;
+        VEC3F normalSum = VEC3F::Zero();
+        for (int e = 0; e < 12; ++e) {
+            int c0 = edgevmap[e][0];
+            int c1 = edgevmap[e][1];
+            if (((node->corners >> c0) & 1) == ((node->corners >> c1) & 1)) continue;
+
+            int o0[3], o1[3], mid[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                o0[axis] = 2 * childOffset(c0, axis);
+                o1[axis] = 2 * childOffset(c1, axis);
+                mid[axis] = (o0[axis] + o1[axis]) / 2;
+            }
+            Real v0 = v[o0[0]][o0[1]][o0[2]];
+            Real vm = v[mid[0]][mid[1]][mid[2]];
+            Real v1 = v[o1[0]][o1[1]][o1[2]];
+            const int* from = o0;
+            const int* to = mid;
+            Real t;
+            if ((v0 > 0) != (vm > 0)) {
+                t = v0 / (v0 - vm);
+            } else {
+                from = mid;
+                to = o1;
+                t = vm / (vm - v1);
+            }
+            VEC3F p = tree.latticePoint(node->x + half * (from[0] + t * (to[0] - from[0])),
+                                        node->y + half * (from[1] + t * (to[1] - from[1])),
+                                        node->z + half * (from[2] + t * (to[2] - from[2])));
+            points[crossings] = p;
+            normals[crossings] = fieldNormal(js, p, idx, num_iter);
+            normalSum += normals[crossings];
+            crossings++;
+        }
+
+        Real length = normalSum.norm();
+        if (!(length > 0)) return false;
+        VEC3F meanNormal = normalSum / length;
+        for (int i = 0; i < crossings; ++i) {
+            if (normals[i].dot(meanNormal) < DC_FLAT_COS) return false;
+        }
+
+        Qef qef;
+        for (int i = 0; i < crossings; ++i) qef.add(points[i], normals[i]);
+        Real error;
+        VEC3F position = qef.solve(tree.nodeMin(*node), tree.nodeMax(*node), &error);
+        if (error > refine.maxError * refine.maxError * qef.count) return false;
+
+        node->type = DC_LEAF;
+        node->qef = qef;
+        node->position = position;
+        return true;
+    };
+
+    local->clear();
+    local->reserve(1 + 8 + 64 + static_cast<size_t>(B) * B * B);
+
+    // Depth first so the subtree of every node is built before it is linked
+    auto build = [&](auto& self, int x, int y, int z, int size) -> int {
+        int nodeIdx = (int)local->size();
+        local->emplace_back();
+        DCNode node;
+        node.x = brick.x + x;
+        node.y = brick.y + y;
+        node.z = brick.z + z;
+        node.size = size;
+
+        if (size > 1) {
+            int half = size / 2;
+
+            // Same narrow band test as DualContouring above the bricks
+            Real centre = sample(x + half, y + half, z + half);
+            Real halfDiagonal = 0.5 * std::sqrt(3.0) * size * tree.h;
+            if (std::abs(centre) - refine.lipschitz * halfDiagonal - 2.0 * refine.perturbation - refine.slack > 0) {
+                node.type = DC_EMPTY;
+                node.corners = centre > 0 ? 255 : 0;
+                (*local)[nodeIdx] = node;
+                return nodeIdx;
+            }
+            if (flatLeaf(x, y, z, size, &node)) {
+                (*local)[nodeIdx] = node;
+                return nodeIdx;
+            }
+
+            node.type = DC_INTERNAL;
+            node.corners = 0;
+            for (int c = 0; c < 8; ++c) {
+                node.children[c] = self(self, x + childOffset(c, 0) * half, y + childOffset(c, 1) * half, z + childOffset(c, 2) * half, half);
+            }
+            (*local)[nodeIdx] = node;
+            return nodeIdx;
+        }
+
+        Real cornerValues[8];
+        for (int c = 0; c < 8; ++c) {
+            cornerValues[c] = sample(x + childOffset(c, 0), y + childOffset(c, 1), z + childOffset(c, 2));
+            if (cornerValues[c] > 0) node.corners |= 1 << c;
+        }
+
+        if (node.corners == 0 || node.corners == 255) {
+            node.type = DC_EMPTY;
+            (*local)[nodeIdx] = node;
+            return nodeIdx;
+        }
+
+        node.type = DC_LEAF;
+        for (int e = 0; e < 12; ++e) {
+            int c0 = edgevmap[e][0];
+            int c1 = edgevmap[e][1];
+            if (((node.corners >> c0) & 1) == ((node.corners >> c1) & 1)) continue;
+
+            Real t = cornerValues[c0] / (cornerValues[c0] - cornerValues[c1]);
+            VEC3F p = tree.latticePoint(node.x + childOffset(c0, 0) + t * (childOffset(c1, 0) - childOffset(c0, 0)),
+                                        node.y + childOffset(c0, 1) + t * (childOffset(c1, 1) - childOffset(c0, 1)),
+                                        node.z + childOffset(c0, 2) + t * (childOffset(c1, 2) - childOffset(c0, 2)));
+
+            int axis = e / 4;
+            size_t key = 3 * sampleIndex(x + childOffset(c0, 0), y + childOffset(c0, 1), z + childOffset(c0, 2)) + axis;
+            if (!edgeDone[key]) {
+                edgeNormals[key] = fieldNormal(js, p, idx, num_iter);
+                edgeDone[key] = 1;
+            }
+            node.qef.add(p, edgeNormals[key]);
+        }
+
+        Real error;
+        node.position = node.qef.solve(tree.nodeMin(node), tree.nodeMax(node), &error);
+        (*local)[nodeIdx] = node;
+        return nodeIdx;
+    };
+    build(build, 0, 0, 0, B);
+}
+
+// Merges subtrees whose vertices can be replaced by one within maxError
+static void simplify(DCOctree& tree, int nodeIdx, Real maxError) {
+    DCNode& node = tree.nodes[nodeIdx];
+    if (node.type != DC_INTERNAL) return;
+
+    for (int c = 0; c < 8; ++c) {
+        simplify(tree, tree.nodes[nodeIdx].children[c], maxError);
+    }
+
+    DCNode& parent = tree.nodes[nodeIdx];
+    Qef merged;
+    unsigned char corners = 0;
+    for (int c = 0; c < 8; ++c) {
+        const DCNode& child = tree.nodes[parent.children[c]];
+        if (child.type == DC_INTERNAL) return;
+        if (child.type == DC_LEAF) merged.add(child.qef);
+        // Corner c of the parent is corner c of child c
+        corners |= child.corners & (1 << c);
+    }
+
+    if (merged.count == 0) {
+        // Every child is provably on one side, and neighbours cannot disagree
+        if (corners == 0 || corners == 255) {
+            parent.type = DC_EMPTY;
+            parent.corners = corners;
+        }
+        return;
+    }
+
+    Real error;
+    VEC3F position = merged.solve(tree.nodeMin(parent), tree.nodeMax(parent), &error);
+    if (error > maxError * maxError * merged.count) return;
+
+    // The children stay in the array but are no longer reachable
+    for (int c = 0; c < 8; ++c) {
+        tree.nodes[parent.children[c]].type = DC_EMPTY;
+    }
+    parent.type = DC_LEAF;
+    parent.corners = corners;
+    parent.qef = merged;
+    parent.position = position;
+}
+
+static void processEdge(const DCOctree& tree, const int nodes[4], int dir, std::vector<uint>& indices) {
+    int minSize = 0;
+    int minIndex = 0;
+    bool flip = false;
+    bool signChange[4];
+    int verts[4];
+
+    for (int i = 0; i < 4; ++i) {
+        const DCNode& node = tree.nodes[nodes[i]];
+        int edge = processEdgeMask[dir][i];
+        int m0 = (node.corners >> edgevmap[edge][0]) & 1;
+        int m1 = (node.corners >> edgevmap[edge][1]) & 1;
+
+        if (i == 0 || node.size < minSize) {
+            minSize = node.size;
+            minIndex = i;
+            flip = m0 != 0;
+        }
+        signChange[i] = m0 != m1;
+        verts[i] = node.vertex;
+    }
+
+    // The smallest cell owns the edge; its sign change decides the quad
+    if (!signChange[minIndex]) return;
+
+    const int tris[2][2][3] = {
+        { {0, 1, 3}, {0, 3, 2} },
+        { {0, 3, 1}, {0, 2, 3} }
+    };
+    for (int t = 0; t < 2; ++t) {
+        uint a = verts[tris[flip][t][0]];
+        uint b = verts[tris[flip][t][1]];
+        uint c = verts[tris[flip][t][2]];
+        // Merged cells can appear twice around an edge
+        if (a == b || b == c || a == c) continue;
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+}
+
+static void edgeProc(const DCOctree& tree, const int nodes[4], int dir, std::vector<uint>& indices) {
+    bool allLeaves = true;
+    for (int i = 0; i < 4; ++i) {
+        DCNodeType type = tree.nodes[nodes[i]].type;
+        // Empty cells are one signed up to their boundary, so no edge they touch crosses
+        if (type == DC_EMPTY) return;
+        if (type == DC_INTERNAL) allLeaves = false;
+    }
+
+    if (allLeaves) {
+        processEdge(tree, nodes, dir, indices);
+        return;
+    }
+
+    for (int half = 0; half < 2; ++half) {
+        int edgeNodes[4];
+        for (int i = 0; i < 4; ++i) {
+            const DCNode& node = tree.nodes[nodes[i]];
+            edgeNodes[i] = node.type == DC_INTERNAL ? node.children[edgeProcEdgeMask[dir][half][i]] : nodes[i];
+        }
+        edgeProc(tree, edgeNodes, edgeProcEdgeMask[dir][half][4], indices);
+    }
+}
+
+static void faceProc(const DCOctree& tree, const int nodes[2], int dir, std::vector<uint>& indices) {
+    const DCNode& n0 = tree.nodes[nodes[0]];
+    const DCNode& n1 = tree.nodes[nodes[1]];
+    if (n0.type == DC_EMPTY || n1.type == DC_EMPTY) return;
+    if (n0.type != DC_INTERNAL && n1.type != DC_INTERNAL) return;
+
+    for (int i = 0; i < 4; ++i) {
+        int faceNodes[2] = {
+            n0.type == DC_INTERNAL ? n0.children[faceProcFaceMask[dir][i][0]] : nodes[0],
+            n1.type == DC_INTERNAL ? n1.children[faceProcFaceMask[dir][i][1]] : nodes[1]
+        };
+        faceProc(tree, faceNodes, faceProcFaceMask[dir][i][2], indices);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        const int* mask = faceProcEdgeMask[dir][i];
+        const int* order = faceProcOrders[mask[0]];
+        int edgeNodes[4];
+        for (int j = 0; j < 4; ++j) {
+            const DCNode& node = order[j] == 0 ? n0 : n1;
+            edgeNodes[j] = node.type == DC_INTERNAL ? node.children[mask[1 + j]] : nodes[order[j]];
+        }
+        edgeProc(tree, edgeNodes, mask[5], indices);
+    }
+}
+
+static void cellProc(const DCOctree& tree, int nodeIdx, std::vector<uint>& indices) {
+    const DCNode& node = tree.nodes[nodeIdx];
+    if (node.type != DC_INTERNAL) return;
+
+    for (int c = 0; c < 8; ++c) {
+        cellProc(tree, node.children[c], indices);
+    }
+    for (int i = 0; i < 12; ++i) {
+        int faceNodes[2] = { node.children[cellProcFaceMask[i][0]], node.children[cellProcFaceMask[i][1]] };
+        faceProc(tree, faceNodes, cellProcFaceMask[i][2], indices);
+    }
+    for (int i = 0; i < 6; ++i) {
+        int edgeNodes[4];
+        for (int j = 0; j < 4; ++j) {
+            edgeNodes[j] = node.children[cellProcEdgeMask[i][j]];
+        }
+        edgeProc(tree, edgeNodes, cellProcEdgeMask[i][4], indices);
+    }
+}
+
+void DualContouring(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, const GridResolution& resolution, ThreadPool& pool, Real errorTolerance, Profile* profile, JobProgress* progress) {
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.normals.clear();
+
+    // Cubic root cell over the box, padded by two finest cells per side like MarchingCubes
+    int depth = 0;
+    int cells = std::max(resolution.nx, std::max(resolution.ny, resolution.nz));
+    while ((1 << depth) < cells && depth < DC_MAX_DEPTH) depth++;
+    const int N = 1 << depth;
+
+    VEC3F extent = maxBox - minBox;
+    Real side = extent.maxCoeff();
+    if (!(side > 0)) return;
+    side *= 1.0 + 4.0 / N;
+
+    DCOctree tree;
+    tree.h = side / N;
+    tree.origin = 0.5 * (minBox + maxBox) - VEC3F(0.5 * side, 0.5 * side, 0.5 * side);
+
+    js.prepareIteration(idx, num_iter);
+
+    // Same narrow band test as MarchingCubes, see there
+    const Real perturbation = js.fieldPerturbationBound(idx, num_iter);
+    const Real lipschitz = js.fieldLipschitzBound();
+    const Real slack = 1e-5 * side;
+    const int brickCells = std::min(N, DC_BRICK_CELLS);
+
+    // Refine level by level, querying the centres of a whole level in parallel
+    ScopedTimer octreeTimer(profile, "octree");
+    tree.nodes.emplace_back();
+    tree.nodes[0].size = N;
+    std::vector<int> frontier(1, 0), next, bricks;
+    std::vector<Real> centreValues;
+    while (!frontier.empty()) {
+        if (progress && progress->cancelled()) return;
+        centreValues.assign(frontier.size(), 0.0);
+        pool.parallelFor(0, frontier.size(), [&](size_t f) {
+            const DCNode& node = tree.nodes[frontier[f]];
+            centreValues[f] = js.queryFieldValue(0.5 * (tree.nodeMin(node) + tree.nodeMax(node)), 4.0, idx, num_iter);
+        });
+
+        next.clear();
+        for (size_t f = 0; f < frontier.size(); ++f) {
+            int nodeIdx = frontier[f];
+            Real halfDiagonal = 0.5 * std::sqrt(3.0) * tree.nodes[nodeIdx].size * tree.h;
+            if (std::abs(centreValues[f]) - lipschitz * halfDiagonal - 2.0 * perturbation - slack > 0) {
+                tree.nodes[nodeIdx].type = DC_EMPTY;
+                tree.nodes[nodeIdx].corners = centreValues[f] > 0 ? 255 : 0;
+                continue;
+            }
+            if (tree.nodes[nodeIdx].size <= brickCells) {
+                bricks.push_back(nodeIdx);
+                continue;
+            }
+
+            DCNode parent = tree.nodes[nodeIdx];
+            int half = parent.size / 2;
+            parent.type = DC_INTERNAL;
+            for (int c = 0; c < 8; ++c) {
+                DCNode child;
+                child.x = parent.x + childOffset(c, 0) * half;
+                child.y = parent.y + childOffset(c, 1) * half;
+                child.z = parent.z + childOffset(c, 2) * half;
+                child.size = half;
+                parent.children[c] = (int)tree.nodes.size();
+                next.push_back(parent.children[c]);
+                tree.nodes.push_back(child);
+            }
+            tree.nodes[nodeIdx] = parent;
+        }
+        frontier.swap(next);
+    }
+    octreeTimer.stop();
+
+    // Refine the bricks near the surface, then splice their subtrees in
+    ScopedTimer bricksTimer(profile, "bricks");
+    const DCRefinement refine = { perturbation, lipschitz, slack, errorTolerance * tree.h };
+    std::vector<std::vector<DCNode>> brickNodes(bricks.size());
+    if (progress) progress->setSteps(bricks.size());
+    pool.parallelFor(0, bricks.size(), [&](size_t b) {
+        if (progress && progress->cancelled()) return;
+        buildBrick(tree, tree.nodes[bricks[b]], js, idx, num_iter, refine, &brickNodes[b]);
+        if (progress) progress->step();
+    });
+    if (progress && progress->cancelled()) return;
+    for (size_t b = 0; b < bricks.size(); ++b) {
+        int offset = (int)tree.nodes.size() - 1;
+        for (DCNode& node : brickNodes[b]) {
+            if (node.type == DC_INTERNAL) {
+                for (int c = 0; c < 8; ++c) node.children[c] += offset;
+            }
+        }
+        tree.nodes[bricks[b]] = brickNodes[b][0];
+        tree.nodes.insert(tree.nodes.end(), brickNodes[b].begin() + 1, brickNodes[b].end());
+    }
+    bricksTimer.stop();
+
+    if (errorTolerance > 0) {
+        ScopedTimer simplifyTimer(profile, "simplify");
+        simplify(tree, 0, errorTolerance * tree.h);
+    }
+
+    // One mesh vertex per leaf, normal from the surface planes it fits
+    ScopedTimer contourTimer(profile, "contour");
+    for (DCNode& node : tree.nodes) {
+        if (node.type != DC_LEAF) continue;
+        profileCount(PROFILE_ACTIVE_CELLS);
+        node.vertex = (int)mesh.vertices.size();
+        mesh.vertices.push_back(node.position);
+        Real length = node.qef.normalSum.norm();
+        mesh.normals.push_back(length > 0 ? VEC3F(node.qef.normalSum / length) : VEC3F(0, 0, 0));
+    }
+
+    cellProc(tree, 0, mesh.indices);
+}
@@ -0,0 +1,25 @@
+// Adaptive dual contouring (Ju, Losasso, Schaefer and Warren 2002)
+// https://www.cs.rice.edu/~jwarren/papers/dualcontour.pdf
+
+#pragma once
+
+#include "JuliaSet.h"
+#include "MarchingCubes.h"
+#include "mesh.h"
+#include "ThreadPool.h"
+
+// Meshes the same field as MarchingCubes on an octree instead of a uniform grid.
+// Cells are refined only where the narrow band test cannot rule out a crossing and,
+// below 8^3 finest cells, only until the surface in a cell is one flat sheet: its
+// corner, edge, face and centre samples agree in sign and fit a trilinear field,
+// and the normals at its crossings stay within about 15 degrees. Leaves are merged
+// again wherever one vertex still fits the surface planes of its children, so flat
+// regions end up with large cells and portal detail keeps the finest ones. The
+// finest cell matches the largest axis of resolution, rounded up to a power of two.
+//
+// errorTolerance is the distance allowed between a flat or merged vertex and the
+// field it replaces (RMS over its surface planes), in finest cells. 0 refines every
+// crossing to the finest cells and keeps them.
+// Stages "octree", "bricks", "simplify" and "contour" are timed into profile if given.
+// progress, if given, advances per brick; once it is cancelled mesh is left empty.
+void DualContouring(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, const GridResolution& resolution, ThreadPool& pool, Real errorTolerance = 0.1, Profile* profile = nullptr, JobProgress* progress = nullptr);
@@ -0,0 +1,470 @@
+// Benchmarks of the fractal pipeline on fixed synthetic meshes and portal settings,
+// so timings are comparable between builds. Prints a table and optionally writes
+// the same numbers as JSON. Also writes field samples and checks them against
+// samples written by another build, e.g. single against double precision.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "FractalGenerator.h"
+
+// Random field queries timed on one thread
+#define BENCH_FIELD_QUERIES 20000
+
+// Field samples per mesh written by --write-field
+#define BENCH_FIELD_SAMPLES 4000
+
+// Largest field value difference --check-field accepts by default. The meshes are
+// about unit size; single precision stays near 1e-6 from double on them.
+#define BENCH_FIELD_TOLERANCE 1e-5
+
+// Sphere with one vertex at each pole and rings in between. roughness > 0 adds
+// fine bumps, standing in for a scanned surface.
+static Mesh sphereMesh(int segments, int rings, Real radius, Real roughness) {
+    Mesh mesh;
+    auto addVertex = [&](Real theta, Real phi, float u, float v) {
+        Real r = radius * (1.0 + roughness * (std::sin(7.0 * theta) * std::sin(5.0 * phi)
+                                            + 0.5 * std::sin(23.0 * theta + 1.3) * std::cos(19.0 * phi)
+                                            + 0.25 * std::sin(61.0 * theta) * std::sin(53.0 * phi + 0.7)));
+        mesh.vertices.push_back(VEC3F(r * std::sin(theta) * std::cos(phi), r * std::sin(theta) * std::sin(phi), r * std::cos(theta)));
+        mesh.uvU.push_back(u);
+        mesh.uvV.push_back(v);
+    };
+
+    addVertex(0.0, 0.0, 0.5f, 1.0f);
+    for (int ring = 1; ring < rings; ++ring) {
+        for (int s = 0; s < segments; ++s) {
+            addVertex(M_PI * ring / rings, 2.0 * M_PI * s / segments, (float)s / segments, 1.0f - (float)ring / rings);
+        }
+    }
+    addVertex(M_PI, 0.0, 0.5f, 0.0f);
+
+    auto ringVertex = [&](int ring, int s) { return (uint)(1 + (ring - 1) * segments + s % segments); };
+    const uint bottom = (uint)mesh.vertices.size() - 1;
+    for (int s = 0; s < segments; ++s) {
+        mesh.indices.insert(mesh.indices.end(), { 0u, ringVertex(1, s), ringVertex(1, s + 1) });
+        for (int ring = 1; ring < rings - 1; ++ring) {
+            uint a0 = ringVertex(ring, s), a1 = ringVertex(ring, s + 1);
+            uint b0 = ringVertex(ring + 1, s), b1 = ringVertex(ring + 1, s + 1);
+            mesh.indices.insert(mesh.indices.end(), { a0, b0, b1, a0, b1, a1 });
+        }
+        mesh.indices.insert(mesh.indices.end(), { bottom, ringVertex(rings - 1, s + 1), ringVertex(rings - 1, s) });
+    }
+    return mesh;
+}
+
+// Torus around the z axis
+static Mesh torusMesh(int segments, int sides, Real majorRadius, Real minorRadius) {
+    Mesh mesh;
+    for (int s = 0; s < segments; ++s) {
+        Real u = 2.0 * M_PI * s / segments;
+        for (int t = 0; t < sides; ++t) {
+            Real v = 2.0 * M_PI * t / sides;
+            Real r = majorRadius + minorRadius * std::cos(v);
+            mesh.vertices.push_back(VEC3F(r * std::cos(u), r * std::sin(u), minorRadius * std::sin(v)));
+            mesh.uvU.push_back((float)s / segments);
+            mesh.uvV.push_back((float)t / sides);
+        }
+    }
+
+    auto vertex = [&](int s, int t) { return (uint)((s % segments) * sides + t % sides); };
+    for (int s = 0; s < segments; ++s) {
+        for (int t = 0; t < sides; ++t) {
+            uint a0 = vertex(s, t), a1 = vertex(s + 1, t);
+            uint b0 = vertex(s, t + 1), b1 = vertex(s + 1, t + 1);
+            mesh.indices.insert(mesh.indices.end(), { a0, a1, b1, a0, b1, b0 });
+        }
+    }
+    return mesh;
+}
+
+// Bounds and the UV transfer source, as meshFromMaya and readMesh leave them
+static Mesh finished(Mesh mesh) {
+    mesh.computeBounds();
+    mesh.uvSetName = "map1";
+    mesh.originalVertices = mesh.vertices;
+    return mesh;
+}
+
+// One portal, two iterations and mild noise
+static FractalSettings canonicalSettings() {
+    FractalSettings settings;
+    settings.posX = 0.5; settings.posY = 0.25; settings.posZ = 0.0;
+    settings.rotX = 15.0; settings.rotY = 0.0; settings.rotZ = 30.0;
+    settings.scaleX = settings.scaleY = settings.scaleZ = 0.6;
+    settings.alpha = 0.05;
+    settings.beta = 0.5;
+    settings.versorScale = 2.0;
+    settings.versorOctave = 2;
+    settings.maxIterations = 2;
+    return settings;
+}
+
+// The work meshToMaya does outside the Maya API: one packed homogeneous copy of
+// the points, the face counts, and the vertex ids for the normals. Connectivity
+// and normals go to Maya straight from the mesh buffers. The UV transfer is timed
+// separately.
+static size_t convertForMaya(const Mesh& mesh) {
+    std::vector<double> points(4 * mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        points[4 * i] = mesh.vertices[i][0];
+        points[4 * i + 1] = mesh.vertices[i][1];
+        points[4 * i + 2] = mesh.vertices[i][2];
+        points[4 * i + 3] = 1.0;
+    }
+    std::vector<int> faceCounts(mesh.indices.size() / 3, 3);
+    std::vector<int> vertexIndices(mesh.normals.size());
+    std::iota(vertexIndices.begin(), vertexIndices.end(), 0);
+    return points.size() + faceCounts.size() + vertexIndices.size();
+}
+
+// Seconds per stage summed over every pass of one mesh; the fastest of the repeats is kept
+struct BenchResult {
+    std::string name;
+    unsigned int threads = 0;
+    size_t inputTriangles = 0;
+    size_t passes = 0;
+    size_t samples = 0;
+    size_t fieldQueries = 0;
+    size_t activeCells = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t dcTriangles = 0;
+
+    double fieldQuerySeconds = 0.0; // per query
+    double bandSeconds = 0.0;
+    double samplingSeconds = 0.0;
+    double polygoniseSeconds = 0.0;
+    double normalSeconds = 0.0;
+    double conversionSeconds = 0.0;
+    double uvTransferSeconds = 0.0;
+    double mcSeconds = 0.0;         // marching cubes end to end
+    double dcSeconds = 0.0;         // dual contouring end to end
+
+    void keepFastest(const BenchResult& other) {
+        fieldQuerySeconds = std::min(fieldQuerySeconds, other.fieldQuerySeconds);
+        bandSeconds = std::min(bandSeconds, other.bandSeconds);
+        samplingSeconds = std::min(samplingSeconds, other.samplingSeconds);
+        polygoniseSeconds = std::min(polygoniseSeconds, other.polygoniseSeconds);
+        normalSeconds = std::min(normalSeconds, other.normalSeconds);
+        conversionSeconds = std::min(conversionSeconds, other.conversionSeconds);
+        uvTransferSeconds = std::min(uvTransferSeconds, other.uvTransferSeconds);
+        mcSeconds = std::min(mcSeconds, other.mcSeconds);
+        dcSeconds = std::min(dcSeconds, other.dcSeconds);
+    }
+};
+
+static BenchResult runBenchmark(const std::string& name, const Mesh& input, FractalSettings settings) {
+    TIMER_INIT();
+    BenchResult result;
+    result.name = name;
+    result.inputTriangles = input.indices.size() / 3;
+
+    settings.useDualContouring = false;
+    FractalGenerator generator(input, settings);
+    const std::vector<FractalPass>& passes = generator.passes();
+    result.passes = passes.size();
+    result.threads = generator.numThreads();
+    if (passes.empty()) return result;
+
+    // Field query throughput on a fixed pseudo random set of points in the first box
+    const FractalPass& first = passes[0];
+    JuliaSet& js = generator.julia();
+    js.prepareIteration(first.portalIdx, first.iteration);
+    unsigned int seed = 12345u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (Real)(1u << 24);
+    };
+    std::vector<VEC3F> points(BENCH_FIELD_QUERIES);
+    for (VEC3F& point : points) {
+        VEC3F t(random01(), random01(), random01());
+        point = first.minBox + t.cwiseProduct(first.maxBox - first.minBox);
+    }
+    volatile Real sink = 0;
+    TIMER_START();
+    for (const VEC3F& point : points) {
+        sink = sink + js.queryFieldValue(point, 4.0, first.portalIdx, first.iteration);
+    }
+    TIMER_END();
+    result.fieldQuerySeconds = TIMER_DURATION / BENCH_FIELD_QUERIES;
+
+    // Marching cubes stage by stage, then the Maya side conversion of each pass
+    Mesh mesh;
+    mesh.fromMesh(input);
+    std::vector<float> u, v;
+    for (const FractalPass& pass : passes) {
+        Profile profile;
+        TIMER_START();
+        generator.meshPass(pass, mesh, &profile);
+        TIMER_END();
+        result.mcSeconds += TIMER_DURATION;
+        result.bandSeconds += profile.seconds("band");
+        result.samplingSeconds += profile.seconds("sampling");
+        result.polygoniseSeconds += profile.seconds("polygonise");
+        result.normalSeconds += profile.seconds("normals");
+        result.samples += pass.resolution.numSamples();
+        result.fieldQueries += profile.count(PROFILE_FIELD_QUERIES);
+        result.activeCells += profile.count(PROFILE_ACTIVE_CELLS);
+        result.vertices += mesh.vertices.size();
+        result.triangles += mesh.indices.size() / 3;
+
+        TIMER_START();
+        sink = sink + (Real)convertForMaya(mesh);
+        TIMER_END();
+        result.conversionSeconds += TIMER_DURATION;
+
+        TIMER_START();
+        mesh.transferUVs(&u, &v, &generator.threadPool());
+        TIMER_END();
+        result.uvTransferSeconds += TIMER_DURATION;
+    }
+
+    settings.useDualContouring = true;
+    FractalGenerator dcGenerator(input, settings);
+    TIMER_START();
+    dcGenerator.generate([&](const FractalPass&, const Mesh& dcMesh, Profile&) {
+        result.dcTriangles += dcMesh.indices.size() / 3;
+    });
+    TIMER_END();
+    result.dcSeconds = TIMER_DURATION;
+    return result;
+}
+
+static void printResult(const BenchResult& r) {
+    std::printf("%-8s %7zu tris  query %7.0f ns  band %7.3f s  sample %7.3f s  polygonise %7.3f s  normals %6.3f s  "
+                "convert %6.3f s  uv %7.3f s  mc %7.3f s  dc %7.3f s\n",
+                r.name.c_str(), r.inputTriangles, r.fieldQuerySeconds * 1e9, r.bandSeconds, r.samplingSeconds,
+                r.polygoniseSeconds, r.normalSeconds, r.conversionSeconds, r.uvTransferSeconds, r.mcSeconds, r.dcSeconds);
+}
+
+static bool writeJson(const std::string& path, const std::vector<BenchResult>& results, const FractalSettings& settings, int repeat) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    std::fprintf(file, "{\n  \"threads\": %u,\n  \"repeat\": %d,\n  \"voxel_budget\": %zu,\n  \"results\": [\n",
+                 results[0].threads, repeat, settings.voxelBudget);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        std::fprintf(file,
+            "    {\"mesh\": \"%s\", \"input_triangles\": %zu, \"passes\": %zu, \"samples\": %zu, "
+            "\"field_queries\": %zu, \"active_cells\": %zu, \"vertices\": %zu, \"triangles\": %zu, \"dc_triangles\": %zu, "
+            "\"field_query_ns\": %.1f, \"band_s\": %.6f, \"sampling_s\": %.6f, \"polygonise_s\": %.6f, "
+            "\"normals_s\": %.6f, \"conversion_s\": %.6f, \"uv_transfer_s\": %.6f, \"mc_total_s\": %.6f, \"dc_total_s\": %.6f}%s\n",
+            r.name.c_str(), r.inputTriangles, r.passes, r.samples, r.fieldQueries, r.activeCells, r.vertices,
+            r.triangles, r.dcTriangles, r.fieldQuerySeconds * 1e9, r.bandSeconds, r.samplingSeconds,
+            r.polygoniseSeconds, r.normalSeconds, r.conversionSeconds, r.uvTransferSeconds, r.mcSeconds,
+            r.dcSeconds, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+// A field value at a point of the first pass of a mesh. Points are kept in
+// double so both builds query the same ones.
+struct FieldSample {
+    std::string mesh;
+    double point[3];
+    double value;
+};
+
+// Half the points spread over the first pass box, half within a twentieth of its
+// size of input vertices, where the surface is meshed
+static std::vector<FieldSample> fieldPoints(const std::string& name, const Mesh& input, const FractalPass& pass) {
+    unsigned int seed = 54321u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (double)(1u << 24);
+    };
+
+    std::vector<FieldSample> samples(BENCH_FIELD_SAMPLES);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        FieldSample& sample = samples[i];
+        sample.mesh = name;
+        sample.value = 0.0;
+        const VEC3F& vertex = input.vertices[(size_t)(random01() * input.vertices.size()) % input.vertices.size()];
+        for (int axis = 0; axis < 3; ++axis) {
+            double lo = pass.minBox[axis], hi = pass.maxBox[axis];
+            sample.point[axis] = i % 2 ? lo + random01() * (hi - lo)
+                                       : vertex[axis] + (random01() - 0.5) * 0.05 * (hi - lo);
+        }
+    }
+    return samples;
+}
+
+// Queries the first pass field of the mesh at every sample, as the mesher does
+static void evaluateField(const Mesh& input, const FractalSettings& settings, std::vector<FieldSample>& samples) {
+    FractalGenerator generator(input, settings);
+    if (generator.passes().empty()) return;
+    const FractalPass& first = generator.passes()[0];
+    JuliaSet& js = generator.julia();
+    js.prepareIteration(first.portalIdx, first.iteration);
+    for (FieldSample& sample : samples) {
+        VEC3F point((Real)sample.point[0], (Real)sample.point[1], (Real)sample.point[2]);
+        sample.value = js.queryFieldValue(point, 4.0, first.portalIdx, first.iteration);
+    }
+}
+
+// First line: the precision of the writing build. Then one sample per line.
+static bool writeField(const std::string& path, const std::vector<FieldSample>& samples) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    std::fprintf(file, "precision %s\n", sizeof(Real) == sizeof(float) ? "single" : "double");
+    for (const FieldSample& sample : samples) {
+        std::fprintf(file, "%s %.17g %.17g %.17g %.17g\n", sample.mesh.c_str(),
+                     sample.point[0], sample.point[1], sample.point[2], sample.value);
+    }
+    return std::fclose(file) == 0;
+}
+
+static bool readField(const std::string& path, std::string* precision, std::vector<FieldSample>* samples) {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) return false;
+
+    char name[64];
+    bool ok = std::fscanf(file, "precision %63s", name) == 1;
+    *precision = name;
+    FieldSample sample;
+    while (ok && std::fscanf(file, "%63s %lf %lf %lf %lf", name, &sample.point[0], &sample.point[1],
+                             &sample.point[2], &sample.value) == 5) {
+        sample.mesh = name;
+        samples->push_back(sample);
+    }
+    ok = ok && std::feof(file);
+    std::fclose(file);
+    return ok && !samples->empty();
+}
+
+// Prints the median, 99.9th percentile and largest difference from the reference
+// samples of the mesh and returns whether the largest is within tolerance
+static bool checkField(const std::string& name, const std::vector<FieldSample>& reference,
+                       const std::vector<FieldSample>& samples, double tolerance) {
+    std::vector<double> errors;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        errors.push_back(std::abs(samples[i].value - reference[i].value));
+    }
+    std::sort(errors.begin(), errors.end());
+    double maxError = errors.back();
+    std::printf("%-8s %5zu samples  median %8.2e  99.9%% %8.2e  max %8.2e  %s\n", name.c_str(), errors.size(),
+                errors[errors.size() / 2], errors[errors.size() * 999 / 1000], maxError,
+                maxError <= tolerance ? "ok" : "FAILED");
+    return maxError <= tolerance;
+}
+
+static void printUsage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s [options]\n"
+        "\n"
+        "  --repeat N              runs per mesh, the fastest is reported (default 3)\n"
+        "  --threads N             worker threads, 0 uses every core (default 0)\n"
+        "  --voxel-budget N        about N cells per pass (default 125000)\n"
+        "  --mesh NAME             only sphere, torus or scan\n"
+        "  --json PATH             also write the results as JSON\n"
+        "  --write-field PATH      write field samples of each mesh instead of timing\n"
+        "  --check-field PATH      compare the field with samples written by --write-field,\n"
+        "                          e.g. by a double precision build; exits 1 if any differ\n"
+        "                          by more than the tolerance\n"
+        "  --field-tolerance X     largest accepted difference (default %g)\n",
+        program, BENCH_FIELD_TOLERANCE);
+}
+
+int main(int argc, char** argv) {
+    FractalSettings settings = canonicalSettings();
+    int repeat = 3;
+    std::string only, jsonPath, writeFieldPath, checkFieldPath;
+    double fieldTolerance = BENCH_FIELD_TOLERANCE;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (flag == "--repeat" && hasValue) repeat = std::max(std::atoi(argv[++i]), 1);
+        else if (flag == "--threads" && hasValue) settings.numThreads = (unsigned int)std::max(std::atoi(argv[++i]), 0);
+        else if (flag == "--voxel-budget" && hasValue) settings.voxelBudget = (size_t)std::max(std::atol(argv[++i]), 1L);
+        else if (flag == "--mesh" && hasValue) only = argv[++i];
+        else if (flag == "--json" && hasValue) jsonPath = argv[++i];
+        else if (flag == "--write-field" && hasValue) writeFieldPath = argv[++i];
+        else if (flag == "--check-field" && hasValue) checkFieldPath = argv[++i];
+        else if (flag == "--field-tolerance" && hasValue) fieldTolerance = std::atof(argv[++i]);
+        else if (flag == "-h" || flag == "--help") { printUsage(argv[0]); return 0; }
+        else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    struct NamedMesh { const char* name; Mesh mesh; };
+    std::vector<NamedMesh> meshes;
+    if (only.empty() || only == "sphere") meshes.push_back({ "sphere", finished(sphereMesh(48, 24, 1.0, 0.0)) });
+    if (only.empty() || only == "torus") meshes.push_back({ "torus", finished(torusMesh(64, 32, 1.0, 0.35)) });
+    if (only.empty() || only == "scan") meshes.push_back({ "scan", finished(sphereMesh(256, 196, 1.0, 0.03)) });
+    if (meshes.empty()) {
+        std::fprintf(stderr, "unknown mesh %s, expected sphere, torus or scan\n", only.c_str());
+        return 2;
+    }
+
+    if (!writeFieldPath.empty()) {
+        std::vector<FieldSample> samples;
+        for (const NamedMesh& named : meshes) {
+            FractalGenerator generator(named.mesh, settings);
+            if (generator.passes().empty()) continue;
+            std::vector<FieldSample> meshSamples = fieldPoints(named.name, named.mesh, generator.passes()[0]);
+            evaluateField(named.mesh, settings, meshSamples);
+            samples.insert(samples.end(), meshSamples.begin(), meshSamples.end());
+        }
+        if (!writeField(writeFieldPath, samples)) {
+            std::fprintf(stderr, "could not write %s\n", writeFieldPath.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!checkFieldPath.empty()) {
+        std::string precision;
+        std::vector<FieldSample> reference;
+        if (!readField(checkFieldPath, &precision, &reference)) {
+            std::fprintf(stderr, "could not read field samples from %s\n", checkFieldPath.c_str());
+            return 1;
+        }
+        std::printf("%s precision against %s precision samples, tolerance %g\n",
+                    sizeof(Real) == sizeof(float) ? "single" : "double", precision.c_str(), fieldTolerance);
+        bool ok = true;
+        size_t checked = 0;
+        for (const NamedMesh& named : meshes) {
+            std::vector<FieldSample> meshReference;
+            for (const FieldSample& sample : reference) {
+                if (sample.mesh == named.name) meshReference.push_back(sample);
+            }
+            if (meshReference.empty()) continue;
+            std::vector<FieldSample> samples = meshReference;
+            evaluateField(named.mesh, settings, samples);
+            ok = checkField(named.name, meshReference, samples, fieldTolerance) && ok;
+            ++checked;
+        }
+        if (!checked) {
+            std::fprintf(stderr, "%s has no samples of the meshes asked for\n", checkFieldPath.c_str());
+            return 1;
+        }
+        return ok ? 0 : 1;
+    }
+
+    std::vector<BenchResult> results;
+    for (const NamedMesh& named : meshes) {
+        BenchResult best = runBenchmark(named.name, named.mesh, settings);
+        for (int run = 1; run < repeat; ++run) {
+            best.keepFastest(runBenchmark(named.name, named.mesh, settings));
+        }
+        printResult(best);
+        results.push_back(best);
+    }
+    if (!jsonPath.empty() && !writeJson(jsonPath, results, settings, repeat)) {
+        std::fprintf(stderr, "could not write %s\n", jsonPath.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "FractalCache.h"
+
+ContentHash& ContentHash::addBytes(const void* data, size_t bytes) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        state = (state ^ p[i]) * 1099511628211ull;
+    }
+    return *this;
+}
+
+FractalCache::FractalCache(size_t maxBytes_) : maxBytes(maxBytes_) {
+}
+
+FractalCache::Entry* FractalCache::find(uint64_t key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        numMisses++;
+        return nullptr;
+    }
+    numHits++;
+    it->second.lastUse = ++useCounter;
+    return &it->second;
+}
+
+void FractalCache::store(uint64_t key, Entry entry) {
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        totalBytes -= it->second.bytes;
+        entries.erase(it);
+    }
+    if (entry.bytes > maxBytes) return;
+
+    // Evict least recently used entries until the new one fits
+    while (totalBytes + entry.bytes > maxBytes && !entries.empty()) {
+        auto oldest = entries.begin();
+        for (auto e = entries.begin(); e != entries.end(); ++e) {
+            if (e->second.lastUse < oldest->second.lastUse) oldest = e;
+        }
+        totalBytes -= oldest->second.bytes;
+        entries.erase(oldest);
+    }
+
+    entry.lastUse = ++useCounter;
+    totalBytes += entry.bytes;
+    entries[key] = entry;
+}
+
+std::shared_ptr<const MeshBVH> FractalCache::findBVH(uint64_t key) {
+    Entry* entry = find(key);
+    return entry ? entry->bvh : nullptr;
+}
+
+void FractalCache::storeBVH(uint64_t key, std::shared_ptr<const MeshBVH> bvh) {
+    Entry entry;
+    entry.bytes = bvh->memoryBytes();
+    entry.bvh = bvh;
+    store(key, entry);
+}
+
+std::shared_ptr<const Mesh> FractalCache::findMesh(uint64_t key) {
+    Entry* entry = find(key);
+    return entry ? entry->mesh : nullptr;
+}
+
+void FractalCache::storeMesh(uint64_t key, std::shared_ptr<const Mesh> mesh) {
+    Entry entry;
+    entry.bytes = (mesh->vertices.size() + mesh->normals.size()) * sizeof(VEC3F) + mesh->indices.size() * sizeof(uint);
+    entry.mesh = mesh;
+    store(key, entry);
+}
+
+std::shared_ptr<const VersorGrid> FractalCache::findVersorGrid(uint64_t key) {
+    Entry* entry = find(key);
+    return entry ? entry->versorGrid : nullptr;
+}
+
+void FractalCache::storeVersorGrid(uint64_t key, std::shared_ptr<const VersorGrid> grid) {
+    Entry entry;
+    entry.bytes = grid->memoryBytes();
+    entry.versorGrid = grid;
+    store(key, entry);
+}
+
+void FractalCache::clear() {
+    entries.clear();
+    totalBytes = 0;
+}
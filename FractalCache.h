@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+#include "mesh.h"
+#include "MeshBVH.h"
+#include "VersorGrid.h"
+
+// 64 bit FNV-1a over the raw bytes of pipeline inputs
+class ContentHash {
+public:
+    ContentHash& addBytes(const void* data, size_t bytes);
+
+    template <typename T>
+    typename std::enable_if<std::is_trivially_copyable<T>::value, ContentHash&>::type add(const T& value) {
+        return addBytes(&value, sizeof(T));
+    }
+
+    // Fixed size Eigen vectors and matrices, by coefficient
+    template <typename Derived>
+    ContentHash& add(const Eigen::MatrixBase<Derived>& values) {
+        for (Eigen::Index i = 0; i < values.size(); ++i) add(values.derived().coeff(i));
+        return *this;
+    }
+
+    // Elements are hashed as raw bytes, so they must hold no padding (VEC3F is fine)
+    template <typename T>
+    ContentHash& add(const std::vector<T>& values) {
+        add(values.size());
+        return values.empty() ? *this : addBytes(values.data(), values.size() * sizeof(T));
+    }
+
+    uint64_t value() const { return state; }
+
+private:
+    uint64_t state = 14695981039346656037ull;
+};
+
+// Intermediate products of earlier generations, keyed by content hashes of their
+// inputs, so regenerating after a small parameter change only reruns the stages
+// whose inputs changed: portal copy BVHs survive noise and resolution changes,
+// whole pass meshes survive changes to other passes,
+// baked noise survives everything but noise and input mesh changes. The least recently used
+// entries are dropped beyond maxBytes. Not thread safe.
+class FractalCache {
+public:
+    explicit FractalCache(size_t maxBytes = size_t(1) << 30);
+
+    std::shared_ptr<const MeshBVH> findBVH(uint64_t key);
+    void storeBVH(uint64_t key, std::shared_ptr<const MeshBVH> bvh);
+
+    // Geometry only: vertices, normals and indices
+    std::shared_ptr<const Mesh> findMesh(uint64_t key);
+    void storeMesh(uint64_t key, std::shared_ptr<const Mesh> mesh);
+
+    std::shared_ptr<const VersorGrid> findVersorGrid(uint64_t key);
+    void storeVersorGrid(uint64_t key, std::shared_ptr<const VersorGrid> grid);
+
+    void clear();
+
+    size_t bytes() const { return totalBytes; }
+    size_t hits() const { return numHits; }
+    size_t misses() const { return numMisses; }
+
+private:
+    struct Entry {
+        std::shared_ptr<const MeshBVH> bvh;
+        std::shared_ptr<const Mesh> mesh;
+        std::shared_ptr<const VersorGrid> versorGrid;
+        size_t bytes = 0;
+        uint64_t lastUse = 0;
+    };
+
+    Entry* find(uint64_t key);
+    void store(uint64_t key, Entry entry);
+
+    std::unordered_map<uint64_t, Entry> entries;
+    size_t maxBytes;
+    size_t totalBytes = 0;
+    uint64_t useCounter = 0;
+    size_t numHits = 0, numMisses = 0;
+};
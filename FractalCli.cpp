@@ -0,0 +1,165 @@
+// Command line driver for the fractal pipeline, for batch generation and profiling
+// without Maya. Mirrors the arguments of FractalCmd.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "FractalGenerator.h"
+#include "MeshIO.h"
+
+static void printUsage(const char* program) {
+    std::fprintf(stderr,
+        "usage: %s input.(obj|ply) output.(obj|ply) [options]\n"
+        "\n"
+        "  --portal-pos X Y Z      portal translation (default 0 0 0)\n"
+        "  --portal-rot X Y Z      portal rotation in degrees (default 0 0 0)\n"
+        "  --portal-scale X Y Z    portal scale (default 1 1 1)\n"
+        "  --alpha A               noise amplitude, 0..10 (default 0)\n"
+        "  --beta B                noise offset, 0..10 (default 0)\n"
+        "  --versor-scale S        noise frequency, 0..10 (default 1)\n"
+        "  --versor-octave N       noise octaves, 0..8 (default 1)\n"
+        "  --iterations N          portal iterations, 0..8 (default 2)\n"
+        "  --low-res               quick preview, at most 10^3 cells per pass\n"
+        "  --voxel-size S          cubic cells of edge S\n"
+        "  --voxel-budget N        about N cells per pass (default 125000)\n"
+        "  --mesher mc|dc          marching cubes or adaptive dual contouring (default mc)\n"
+        "  --simplify-error E      dual contouring merge tolerance in finest cells (default 0.1)\n"
+        "  --threads N             worker threads, 0 uses every core (default 0)\n"
+        "  --separate-passes       mesh every portal copy on its own instead of their union\n"
+        "  --bake-noise            read the noise from a grid baked once instead of per query\n"
+        "  --noise-tolerance T     baked noise error per channel (default 0.01)\n"
+        "  --julia-blend B         blend of the quaternion Julia field into the mesh, 0..1 (default 0)\n"
+        "  --julia-scale S         input space size of one Julia unit (default 1)\n"
+        "  --julia-iterations N    Julia orbit length, 1..32 (default 12)\n"
+        "  --split                 write every pass to OUTPUT_p<portal>_i<iteration>.ext, or\n"
+        "                          OUTPUT_all.ext for the union\n"
+        "  --profile PATH          write per pass stage timings and counters as JSON\n",
+        program);
+}
+
+// output.obj -> output_p0_i1.obj, or output_all.obj for the composite pass
+static std::string passPath(const std::string& path, const FractalPass& pass) {
+    size_t dot = path.find_last_of('.');
+    std::string suffix = pass.isComposite() ? "_all" : "_p" + std::to_string(pass.portalIdx) + "_i" + std::to_string(pass.iteration);
+    if (dot == std::string::npos) return path + suffix;
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::string inputPath = argv[1];
+    std::string outputPath = argv[2];
+    FractalSettings settings;
+    bool split = false;
+    std::string profilePath;
+
+    for (int i = 3; i < argc; ++i) {
+        std::string flag = argv[i];
+        int remaining = argc - i - 1;
+        auto needs = [&](int count) {
+            if (remaining < count) {
+                std::fprintf(stderr, "%s expects %d value%s\n", flag.c_str(), count, count > 1 ? "s" : "");
+                std::exit(2);
+            }
+        };
+        auto real = [&]() { return std::atof(argv[++i]); };
+        auto count = [&]() { int value = std::atoi(argv[++i]); return value > 0 ? (unsigned int)value : 0u; };
+
+        if (flag == "--portal-pos") { needs(3); settings.posX = real(); settings.posY = real(); settings.posZ = real(); }
+        else if (flag == "--portal-rot") { needs(3); settings.rotX = real(); settings.rotY = real(); settings.rotZ = real(); }
+        else if (flag == "--portal-scale") { needs(3); settings.scaleX = real(); settings.scaleY = real(); settings.scaleZ = real(); }
+        else if (flag == "--alpha") { needs(1); settings.alpha = real(); }
+        else if (flag == "--beta") { needs(1); settings.beta = real(); }
+        else if (flag == "--versor-scale") { needs(1); settings.versorScale = real(); }
+        else if (flag == "--versor-octave") { needs(1); settings.versorOctave = count(); }
+        else if (flag == "--iterations") { needs(1); settings.maxIterations = count(); }
+        else if (flag == "--low-res") { settings.isLowRes = true; }
+        else if (flag == "--voxel-size") { needs(1); settings.voxelSize = real(); }
+        else if (flag == "--voxel-budget") { needs(1); settings.voxelBudget = count(); }
+        else if (flag == "--simplify-error") { needs(1); settings.simplifyError = real(); }
+        else if (flag == "--threads") { needs(1); settings.numThreads = count(); }
+        else if (flag == "--separate-passes") { settings.separatePasses = true; }
+        else if (flag == "--bake-noise") { settings.bakeNoise = true; }
+        else if (flag == "--noise-tolerance") { needs(1); settings.noiseTolerance = real(); }
+        else if (flag == "--julia-blend") { needs(1); settings.juliaBlend = real(); }
+        else if (flag == "--julia-scale") { needs(1); settings.juliaScale = real(); }
+        else if (flag == "--julia-iterations") { needs(1); settings.juliaIterations = count(); }
+        else if (flag == "--split") { split = true; }
+        else if (flag == "--profile") { needs(1); profilePath = argv[++i]; }
+        else if (flag == "--mesher") {
+            needs(1);
+            std::string mesher = argv[++i];
+            if (mesher != "mc" && mesher != "dc") {
+                std::fprintf(stderr, "unknown mesher %s, expected mc or dc\n", mesher.c_str());
+                return 2;
+            }
+            settings.useDualContouring = mesher == "dc";
+        }
+        else if (flag == "-h" || flag == "--help") { printUsage(argv[0]); return 0; }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::string error;
+    Mesh inputMesh;
+    if (!readMesh(inputPath, &inputMesh, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::printf("%s: %zu vertices, %zu triangles\n", inputPath.c_str(), inputMesh.vertices.size(), inputMesh.indices.size() / 3);
+
+    FractalGenerator generator(inputMesh, settings);
+    const std::vector<FractalPass>& passes = generator.passes();
+    if (passes.empty()) {
+        std::fprintf(stderr, "nothing to mesh: --separate-passes needs at least one portal iteration\n");
+        return 2;
+    }
+    FractalEstimate estimate = generator.estimate();
+    std::printf("%zu passes, %dx%dx%d cells in the first, %zu samples, %.1f MB grid memory, about %.2f s on %u threads\n",
+                passes.size(), passes[0].resolution.nx, passes[0].resolution.ny, passes[0].resolution.nz,
+                estimate.totalSamples, estimate.peakBytes / (1024.0 * 1024.0), estimate.seconds, generator.numThreads());
+
+    Mesh combined;
+    combined.fromMesh(inputMesh);
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Profile> profiles;
+    generator.generate([&](const FractalPass& pass, const Mesh& mesh, Profile& profile) {
+        {
+            ScopedTimer timer(&profile, "output");
+            if (split) {
+                if (!writeMesh(passPath(outputPath, pass), mesh, &error)) ok = false;
+            } else {
+                combined.append(mesh);
+            }
+        }
+
+        std::printf("%s: %dx%dx%d cells, %zu vertices, %zu triangles, %.3f s\n  %s\n",
+                    describePass(pass).c_str(), pass.resolution.nx, pass.resolution.ny, pass.resolution.nz,
+                    mesh.vertices.size(), mesh.indices.size() / 3, profile.totalSeconds(), profile.summary().c_str());
+        profiles.push_back(profile);
+    });
+    std::printf("generated in %.3f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    if (!split && ok) {
+        ok = writeMesh(outputPath, combined, &error);
+    }
+    if (ok && !profilePath.empty()) {
+        ok = writeProfileReport(profilePath, passes, profiles, &error);
+    }
+    if (!ok) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -6,14 +6,174 @@
 #include <maya/MSelectionList.h>
 #include <maya/MDagPath.h>
 #include <maya/MPointArray.h>
+#include <maya/MTimerMessage.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <list>
+#include <memory>
 
-#include "JuliaSet.h"
-#include "MarchingCubes.h"
-#include "mesh.h"
+#include "FractalGenerator.h"
+#include "MayaMesh.h"
 #include "PortalMap.h"
 
-#define BBOX_SIZE 8
+// Portal copy BVHs and pass meshes of earlier Generate presses, kept while the
+// plugin is loaded so nudging one parameter only reruns what it affects. Only the
+// running job touches it.
+static FractalCache fractalCache;
+
+// One FractalCmd call: meshed on a background thread, committed to the scene from
+// the main thread once every pass is done
+struct FractalJob {
+    MString meshName;
+    MObject material;
+    MString profilePath;
+    bool useCache = true;
+    size_t cacheHitsBefore = 0;
+
+    std::unique_ptr<FractalGenerator> generator;
+    JobProgress progress;
+
+    // Written by the background thread, read once result is ready
+    std::vector<Mesh> meshes;
+    std::vector<Profile> profiles;
+
+    // Last, so it is destroyed (and waited on) before the generator
+    std::future<bool> result;
+};
+
+// Jobs run one at a time in the order they were issued; the front one is running
+static std::deque<std::unique_ptr<FractalJob>> fractalJobs;
+static MCallbackId jobTimerId = 0;
+static bool jobTimerActive = false;
+
+#define JOB_POLL_SECONDS 0.1f
+
+static void setProgressBar(int percent) {
+    MString cmd = "if (`progressBar -exists myFractalProgress`) progressBar -e -progress ";
+    cmd += percent;
+    cmd += " myFractalProgress;";
+    MGlobal::executeCommand(cmd);
+}
+
+static void startJob(FractalJob& job) {
+    job.cacheHitsBefore = fractalCache.hits();
+
+    // Report the cost up front, the field is timed on a few samples of the first pass
+    const std::vector<FractalPass>& passes = job.generator->passes();
+    if (!passes.empty()) {
+        FractalEstimate estimate = job.generator->estimate();
+
+        MString info;
+        info += "Fractal grid: ";
+        info += (int)passes.size();
+        info += " passes, ";
+        info += (int)passes[0].resolution.nx;
+        info += "x";
+        info += (int)passes[0].resolution.ny;
+        info += "x";
+        info += (int)passes[0].resolution.nz;
+        info += " cells in the first, ";
+        info += (double)estimate.totalSamples;
+        info += " samples, ";
+        info += estimate.peakBytes / (1024.0 * 1024.0);
+        info += " MB grid memory, about ";
+        info += estimate.seconds;
+        info += " s on ";
+        info += (int)job.generator->numThreads();
+        info += " threads";
+        MGlobal::displayInfo(info);
+    }
+
+    FractalJob* jobPtr = &job;
+    job.result = job.generator->generateAsync([jobPtr](const FractalPass&, const Mesh& fractalMesh, Profile& profile) {
+        jobPtr->meshes.push_back(fractalMesh);
+        jobPtr->profiles.push_back(profile);
+    }, &job.progress);
+}
+
+// Main thread only, after the job's result is ready
+static void commitJob(FractalJob& job) {
+    if (!job.result.get()) {
+        MGlobal::displayWarning("Fractal processing cancelled for mesh: " + job.meshName);
+        return;
+    }
+
+    const std::vector<FractalPass>& passes = job.generator->passes();
+    for (size_t i = 0; i < job.meshes.size(); ++i) {
+        Profile& profile = job.profiles[i];
+        meshToMaya(job.meshes[i], job.material, &profile, &job.generator->threadPool());
+
+        MString info;
+        info += describePass(passes[i]).c_str();
+        info += ": ";
+        info += profile.totalSeconds();
+        info += " s, ";
+        info += profile.summary().c_str();
+        MGlobal::displayInfo(info);
+    }
+
+    if (job.useCache) {
+        MString info;
+        info += "Fractal cache: ";
+        info += (int)(fractalCache.hits() - job.cacheHitsBefore);
+        info += " hits, ";
+        info += fractalCache.bytes() / (1024.0 * 1024.0);
+        info += " MB held";
+        MGlobal::displayInfo(info);
+    }
+
+    if (job.profilePath.length() > 0) {
+        std::string error;
+        if (!writeProfileReport(job.profilePath.asChar(), passes, job.profiles, &error)) {
+            MGlobal::displayWarning(error.c_str());
+        }
+    }
+
+    // Print confirmation
+    MGlobal::displayInfo("Fractal processing completed for mesh: " + job.meshName);
+}
+
+static void stopJobTimer() {
+    if (jobTimerActive) {
+        MMessage::removeCallback(jobTimerId);
+        jobTimerActive = false;
+    }
+}
+
+// Timer callback on the main thread: commits the finished job, starts the next
+// one and updates the progress bar
+static void pollJobs(float, float, void*) {
+    while (!fractalJobs.empty()) {
+        FractalJob& job = *fractalJobs.front();
+        if (!job.result.valid()) startJob(job);
+
+        if (job.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            setProgressBar((int)(100.0f * job.progress.fraction()));
+            return;
+        }
+        commitJob(job);
+        fractalJobs.pop_front();
+    }
+
+    setProgressBar(0);
+    stopJobTimer();
+}
+
+void cancelFractalJobs() {
+    for (auto& job : fractalJobs) {
+        job->progress.cancel();
+    }
+    for (auto& job : fractalJobs) {
+        if (job->result.valid()) job->result.wait();
+    }
+    if (!fractalJobs.empty()) {
+        MGlobal::displayWarning("Fractal processing cancelled");
+    }
+    fractalJobs.clear();
+    stopJobTimer();
+    setProgressBar(0);
+}
 
 FractalCmd::FractalCmd() : MPxCommand()
 {
@@ -41,40 +201,113 @@ MStatus FractalCmd::doIt(const MArgList& args)
 	// message in scriptor editor
 	MGlobal::displayInfo("FractalCmd");
 
-    double escapeRadius = 4.0;
-    double cx = 0.0, cy = 0.5, cz = 0.0, cw = 0.0;
-
-    double posX, posY, posZ, rotX, rotY, rotZ, scaleX, scaleY, scaleZ, 
-        alpha, beta, versorScale;
-    unsigned int versorOctave = 1u;
-    unsigned int maxIterations = 2;
+    // FractalCmd -cancel stops the running job and drops the queued ones
+    if (args.flagIndex("ca", "cancel") != MArgList::kInvalidArgIndex) {
+        cancelFractalJobs();
+        return MStatus::kSuccess;
+    }
 
+    FractalSettings settings;
     MString meshName = args.asString(0);
-    posX = args.asDouble(1);
-    posY = args.asDouble(2);
-    posZ = args.asDouble(3);
-    rotX = args.asDouble(4);
-    rotY = args.asDouble(5);
-    rotZ = args.asDouble(6);
-    scaleX = args.asDouble(7);
-    scaleY = args.asDouble(8);
-    scaleZ = args.asDouble(9);
-    alpha = args.asDouble(10);
-    beta = args.asDouble(11);
-    versorScale = args.asDouble(12);
-    versorOctave = static_cast<unsigned int>(args.asInt(13));
-    maxIterations = static_cast<unsigned int>(args.asInt(14));
-    bool isLowRes = args.asBool(15);
-    
-    // Validate ranges (clamp if necessary)
-    if (alpha < 0.0) alpha = 0.0;
-    if (alpha > 10.0) alpha = 10.0;
-    if (beta < 0.0) beta = 0.0;
-    if (beta > 10.0) beta = 10.0;
-    if (versorScale < 0.0) versorScale = 0.0;
-    if (versorScale > 10.0) versorScale = 10.0;
-    if (versorOctave > 8u) versorOctave = 8u;
-    if (maxIterations > 8u) maxIterations = 8u;
+    settings.posX = args.asDouble(1);
+    settings.posY = args.asDouble(2);
+    settings.posZ = args.asDouble(3);
+    settings.rotX = args.asDouble(4);
+    settings.rotY = args.asDouble(5);
+    settings.rotZ = args.asDouble(6);
+    settings.scaleX = args.asDouble(7);
+    settings.scaleY = args.asDouble(8);
+    settings.scaleZ = args.asDouble(9);
+    settings.alpha = args.asDouble(10);
+    settings.beta = args.asDouble(11);
+    settings.versorScale = args.asDouble(12);
+    settings.versorOctave = static_cast<unsigned int>(args.asInt(13));
+    settings.maxIterations = static_cast<unsigned int>(args.asInt(14));
+    settings.isLowRes = args.asBool(15);
+
+    // Optional flags after the positional arguments
+    unsigned int flagIdx = args.flagIndex("th", "threads");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        int threadsArg = args.asInt(flagIdx + 1);
+        settings.numThreads = threadsArg > 0 ? static_cast<unsigned int>(threadsArg) : 0u;
+    }
+
+    // Grid resolution: an explicit voxel size wins over a voxel budget. Without
+    // either the old 50^3 (10^3 in low res) cell count is kept as the budget.
+    flagIdx = args.flagIndex("vs", "voxelSize");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        settings.voxelSize = args.asDouble(flagIdx + 1);
+    }
+    flagIdx = args.flagIndex("vb", "voxelBudget");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        int budgetArg = args.asInt(flagIdx + 1);
+        if (budgetArg > 0) settings.voxelBudget = static_cast<size_t>(budgetArg);
+    }
+
+    // Meshing backend: "mc" (uniform marching cubes, default) or "dc" (adaptive
+    // dual contouring, merging cells within -simplifyError finest cells)
+    flagIdx = args.flagIndex("me", "mesher");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        MString mesher = args.asString(flagIdx + 1);
+        if (mesher == "dc") {
+            settings.useDualContouring = true;
+        } else if (mesher != "mc") {
+            MGlobal::displayError("Unknown mesher " + mesher + ", expected mc or dc");
+            return MStatus::kFailure;
+        }
+    }
+    flagIdx = args.flagIndex("se", "simplifyError");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        settings.simplifyError = args.asDouble(flagIdx + 1);
+    }
+
+    // Default is one pass over the union of every portal copy
+    settings.separatePasses = args.flagIndex("sp", "separatePasses") != MArgList::kInvalidArgIndex;
+
+    // Baked noise, within -noiseTolerance of exact per channel
+    settings.bakeNoise = args.flagIndex("bn", "bakeNoise") != MArgList::kInvalidArgIndex;
+    flagIdx = args.flagIndex("nt", "noiseTolerance");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        settings.noiseTolerance = args.asDouble(flagIdx + 1);
+    }
+
+    // Quaternion Julia field blended into the mesh field, off at -juliaBlend 0
+    flagIdx = args.flagIndex("jb", "juliaBlend");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        settings.juliaBlend = args.asDouble(flagIdx + 1);
+    }
+    flagIdx = args.flagIndex("js", "juliaScale");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        settings.juliaScale = args.asDouble(flagIdx + 1);
+    }
+    flagIdx = args.flagIndex("ji", "juliaIterations");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        int iterationsArg = args.asInt(flagIdx + 1);
+        if (iterationsArg > 0) settings.juliaIterations = static_cast<unsigned int>(iterationsArg);
+    }
+
+    // -noCache regenerates from scratch without touching the cache, -clearCache
+    // empties it first
+    bool useCache = args.flagIndex("nc", "noCache") == MArgList::kInvalidArgIndex;
+    if (args.flagIndex("cc", "clearCache") != MArgList::kInvalidArgIndex) {
+        if (fractalJobs.empty()) {
+            fractalCache.clear();
+        } else {
+            MGlobal::displayWarning("The fractal cache is in use by a running job and was not cleared");
+        }
+    }
+
+    // Without an event loop (batch mode) or with -synchronous the command only
+    // returns once the result is in the scene
+    bool synchronous = args.flagIndex("sy", "synchronous") != MArgList::kInvalidArgIndex
+                    || MGlobal::mayaState() != MGlobal::kInteractive;
+
+    // Per pass stage timings are always printed; -profile also writes them as JSON
+    MString profilePath;
+    flagIdx = args.flagIndex("pf", "profile");
+    if (flagIdx != MArgList::kInvalidArgIndex) {
+        profilePath = args.asString(flagIdx + 1);
+    }
 
     MSelectionList selection;
     MDagPath dagPath;
@@ -88,74 +321,39 @@ MStatus FractalCmd::doIt(const MArgList& args)
     MFnMesh mayaMesh(dagPath);
 
     // Convert input MFnMesh to custom mesh class
+    std::unique_ptr<FractalJob> job(new FractalJob());
+    job->meshName = meshName;
+    job->profilePath = profilePath;
+    job->useCache = useCache;
+
     Mesh inputMesh;
-    inputMesh.fromMaya(mayaMesh);
-
-    // Set up versor field. The seed values are from the authors.
-    Versor versor = Versor(83888u, 39388u, 17474u, versorOctave, versorScale);
-
-    // Construct Julia Set with the PortalMap
-    PortalMap portalMap = PortalMap();
-    portalMap.addPortal(posX, posY, posZ, rotX, rotY, rotZ, scaleX, scaleY, scaleZ);
-    QUATERNION juliaC(cw, cx, cy, cz);
-    JuliaSet juliaSet(maxIterations, escapeRadius, alpha, beta, juliaC, versor);
-
-    juliaSet.setInputMesh(inputMesh);
-    juliaSet.setPortalMap(portalMap);
-
-    // Perform marching cubes
-    Mesh fractalMesh;
-    fractalMesh.fromMesh(inputMesh);
-
-    auto getBboxMinMax = [](VEC3F bbox[BBOX_SIZE], VEC3F* minVert, VEC3F* maxVert) {
-        *minVert = bbox[0];
-        *maxVert = bbox[0];
-        for (size_t i = 1; i < BBOX_SIZE; ++i) {
-            *minVert = VEC3F(min((*minVert)[0], bbox[i][0]), min((*minVert)[1], bbox[i][1]), min((*minVert)[2], bbox[i][2]));
-            *maxVert = VEC3F(max((*maxVert)[0], bbox[i][0]), max((*maxVert)[1], bbox[i][1]), max((*maxVert)[2], bbox[i][2]));
-        }
-    };
-
-    VEC3F bbox[BBOX_SIZE] = {
-        VEC3F(inputMesh.minVert[0] - alpha, inputMesh.minVert[1] - alpha, inputMesh.minVert[2] - alpha),
-        VEC3F(inputMesh.minVert[0] - alpha, inputMesh.minVert[1] - alpha, inputMesh.maxVert[2] + alpha),
-        VEC3F(inputMesh.minVert[0] - alpha, inputMesh.maxVert[1] + alpha, inputMesh.minVert[2] - alpha),
-        VEC3F(inputMesh.maxVert[0] + alpha, inputMesh.minVert[1] - alpha, inputMesh.minVert[2] - alpha),
-        VEC3F(inputMesh.minVert[0] - alpha, inputMesh.maxVert[1] + alpha, inputMesh.maxVert[2] + alpha),
-        VEC3F(inputMesh.maxVert[0] + alpha, inputMesh.minVert[1] - alpha, inputMesh.maxVert[2] + alpha),
-        VEC3F(inputMesh.maxVert[0] + alpha, inputMesh.maxVert[1] + alpha, inputMesh.minVert[2] - alpha),
-        VEC3F(inputMesh.maxVert[0] + alpha, inputMesh.maxVert[1] + alpha, inputMesh.maxVert[2] + alpha)
-    };
-
-    VEC3F minBoxIter, maxBoxIter;
-    VEC3F currBbox[8];
-    for (size_t portalIdx = 0; portalIdx < juliaSet.pm.portalTransforms.size(); ++portalIdx) {
-        for (unsigned int i = 1; i <= maxIterations; ++i) {
-            if (i == 1) {
-                for (size_t cornerIdx = 0; cornerIdx < BBOX_SIZE; ++cornerIdx) {
-                    currBbox[cornerIdx] = juliaSet.pm.getFieldValue(bbox[cornerIdx], portalIdx, i);
-                }
-                getBboxMinMax(currBbox, &minBoxIter, &maxBoxIter);
-            
-                MarchingCubes(fractalMesh, juliaSet, minBoxIter, maxBoxIter, portalIdx, i, isLowRes);
-                MFnMesh outputMesh = fractalMesh.toMaya();
-                continue;
-            }
-
-            for (size_t cornerIdx = 0; cornerIdx < BBOX_SIZE; ++cornerIdx) {
-                // Apply the transformation matrix iteratively through parameter i
-                currBbox[cornerIdx] = juliaSet.pm.getFieldValue(bbox[cornerIdx], portalIdx, i);
-            }
-            getBboxMinMax(currBbox, &minBoxIter, &maxBoxIter);
-
-            MarchingCubes(fractalMesh, juliaSet, {minBoxIter[0], minBoxIter[1], minBoxIter[2]}, {maxBoxIter[0], maxBoxIter[1], maxBoxIter[2]}, portalIdx, i, isLowRes);
-            MFnMesh outputMesh = fractalMesh.toMaya();
+    meshFromMaya(mayaMesh, &inputMesh, &job->material);
+    job->generator.reset(new FractalGenerator(inputMesh, settings, useCache ? &fractalCache : nullptr));
+    if (job->generator->passes().empty()) {
+        MGlobal::displayError("Nothing to mesh: separate passes need at least one portal iteration");
+        return MStatus::kFailure;
+    }
+    fractalJobs.push_back(std::move(job));
+
+    if (synchronous) {
+        while (!fractalJobs.empty()) {
+            FractalJob& front = *fractalJobs.front();
+            if (!front.result.valid()) startJob(front);
+            front.result.wait();
+            commitJob(front);
+            fractalJobs.pop_front();
         }
+        stopJobTimer();
+        return MStatus::kSuccess;
     }
 
-    // Print confirmation
-    MGlobal::displayInfo("Fractal processing completed for mesh: " + meshName);
+    // Progress, the commit and the next job are driven from a main thread timer
+    if (!jobTimerActive) {
+        MStatus status;
+        jobTimerId = MTimerMessage::addTimerCallback(JOB_POLL_SECONDS, pollJobs, nullptr, &status);
+        jobTimerActive = status == MS::kSuccess;
+    }
+    pollJobs(0.0f, 0.0f, nullptr);
 
     return MStatus::kSuccess;
 }
-
@@ -13,4 +13,7 @@ public:
     MStatus doIt(const MArgList& args);
 };
 
+// Cancels the running fractal job, waits for it and drops the queued ones
+void cancelFractalJobs();
+
 #endif
\ No newline at end of file
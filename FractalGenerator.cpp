@@ -0,0 +1,385 @@
+#include "FractalGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+#include "DualContouring.h"
+
+#define BBOX_SIZE 8
+// Noise grid padding around the input bounds, as a fraction of their largest extent
+#define NOISE_GRID_MARGIN 0.1
+// Largest noise grid, about 100 MB
+#define NOISE_GRID_MAX_SAMPLES (size_t(1) << 23)
+
+void FractalSettings::validate() {
+    // Validate ranges (clamp if necessary)
+    alpha = std::min(std::max(alpha, 0.0), 10.0);
+    beta = std::min(std::max(beta, 0.0), 10.0);
+    versorScale = std::min(std::max(versorScale, 0.0), 10.0);
+    versorOctave = std::min(versorOctave, 8u);
+    maxIterations = std::min(maxIterations, 8u);
+    simplifyError = std::max(simplifyError, 0.0);
+    if (voxelSize < 0.0) voxelSize = 0.0;
+    if (voxelBudget == 0) voxelBudget = 1;
+    noiseTolerance = std::min(std::max(noiseTolerance, 1e-6), 1.0);
+    juliaBlend = std::min(std::max(juliaBlend, 0.0), 1.0);
+    juliaScale = std::min(std::max(juliaScale, 1e-3), 1e3);
+    juliaIterations = std::min(std::max(juliaIterations, 1u), 32u);
+
+    // Low res stays a quick preview whatever was asked for
+    if (isLowRes) {
+        voxelSize = 0.0;
+        voxelBudget = std::min<size_t>(voxelBudget, 10 * 10 * 10);
+    }
+}
+
+static FractalSettings validated(FractalSettings settings) {
+    settings.validate();
+    return settings;
+}
+
+FractalGenerator::FractalGenerator(const Mesh& input, const FractalSettings& settings_, FractalCache* cache_)
+    : settings(validated(settings_)),
+      inputMesh(input),
+      // The versor seeds and Julia constant are from the authors
+      juliaSet(settings.juliaIterations, 4.0, settings.alpha, settings.beta, QUATERNION(0.0, 0.0, 0.5, 0.0),
+               Versor(83888u, 39388u, 17474u, settings.versorOctave, settings.versorScale)),
+      pool(settings.numThreads),
+      cache(cache_)
+{
+    PortalMap portalMap = PortalMap();
+    portalMap.addPortal(settings.posX, settings.posY, settings.posZ,
+                        settings.rotX, settings.rotY, settings.rotZ,
+                        settings.scaleX, settings.scaleY, settings.scaleZ);
+
+    juliaSet.setInputMesh(inputMesh);
+    juliaSet.setPortalMap(portalMap);
+    juliaSet.setJuliaField(settings.juliaBlend, settings.juliaScale);
+
+    planPasses();
+
+    if (cache) {
+        inputKey = ContentHash().add(inputMesh.vertices).add(inputMesh.indices).value();
+    }
+}
+
+uint64_t FractalGenerator::iterationKey(size_t portalIdx, unsigned int iteration) {
+    // The portal copy depends on the input geometry and the pass transform only
+    MAT4 transform = juliaSet.getPortalMap().getTransform(portalIdx, iteration);
+    return ContentHash().add('B').add(inputKey).add(transform).value();
+}
+
+uint64_t FractalGenerator::passKey(const FractalPass& pass) {
+    // Everything the field and the mesher read. The versor seeds are fixed above.
+    ContentHash hash;
+    hash.add('M').add(inputKey);
+    if (pass.isComposite()) {
+        for (const auto& member : juliaSet.getCompositeMembers()) {
+            hash.add(juliaSet.getPortalMap().getTransform(member.first, member.second));
+        }
+    } else {
+        hash.add(juliaSet.getPortalMap().getTransform(pass.portalIdx, pass.iteration));
+    }
+    return hash.add(settings.alpha).add(settings.beta).add(settings.versorScale).add(settings.versorOctave)
+        .add(pass.minBox).add(pass.maxBox).add(pass.resolution)
+        .add(settings.useDualContouring).add(settings.useDualContouring ? settings.simplifyError : 0.0)
+        .add(settings.bakeNoise).add(settings.bakeNoise ? settings.noiseTolerance : 0.0)
+        .add(settings.juliaBlend)
+        .add(settings.juliaBlend > 0.0 ? settings.juliaScale : 0.0)
+        .add(settings.juliaBlend > 0.0 ? settings.juliaIterations : 0u)
+        .value();
+}
+
+void FractalGenerator::prepareIteration(const FractalPass& pass, JobProgress* progress) {
+    if (pass.isComposite()) {
+        for (const auto& member : juliaSet.getCompositeMembers()) {
+            if (progress && progress->cancelled()) return;
+            prepareIteration(member.first, (unsigned int)member.second);
+        }
+    } else {
+        prepareIteration(pass.portalIdx, pass.iteration);
+    }
+}
+
+void FractalGenerator::prepareIteration(size_t portalIdx, unsigned int iteration) {
+    if (juliaSet.iterationBVH(portalIdx, iteration)) return;
+
+    if (cache) {
+        uint64_t key = iterationKey(portalIdx, iteration);
+        std::shared_ptr<const MeshBVH> bvh = cache->findBVH(key);
+        if (bvh) {
+            juliaSet.setIterationBVH(portalIdx, iteration, bvh);
+            return;
+        }
+        juliaSet.prepareIteration(portalIdx, iteration);
+        cache->storeBVH(key, juliaSet.iterationBVH(portalIdx, iteration));
+        return;
+    }
+    juliaSet.prepareIteration(portalIdx, iteration);
+}
+
+void FractalGenerator::prepareNoise(Profile* profile) {
+    if (noisePrepared) return;
+    noisePrepared = true;
+    if (!settings.bakeNoise || settings.alpha == 0.0) return;
+    ScopedTimer timer(profile, "noise");
+
+    // Field queries evaluate the noise at input space points offset by beta. The
+    // queries that matter are near the portal copies, so the box is the input bounds
+    // grown by the noise amplitude and a margin; farther ones fall back to exact noise.
+    const Versor& versor = juliaSet.getNoise();
+    VEC3F extent = inputMesh.maxVert - inputMesh.minVert;
+    Real pad = settings.alpha + NOISE_GRID_MARGIN * extent.maxCoeff();
+    VEC3F offset = VEC3F::Constant(settings.beta);
+    VEC3F minBox = inputMesh.minVert + offset - VEC3F::Constant(pad);
+    VEC3F maxBox = inputMesh.maxVert + offset + VEC3F::Constant(pad);
+
+    uint64_t key = 0;
+    if (cache) {
+        key = ContentHash().add('V')
+            .add(versor.nx.serialize()).add(versor.ny.serialize()).add(versor.nz.serialize())
+            .add(versor.scale).add(versor.octave).add(minBox).add(maxBox).add(settings.noiseTolerance)
+            .value();
+        std::shared_ptr<const VersorGrid> grid = cache->findVersorGrid(key);
+        if (grid) {
+            juliaSet.setNoiseGrid(grid);
+            return;
+        }
+    }
+
+    // A grid too large for the tolerance is not worth it; the noise stays exact
+    std::shared_ptr<VersorGrid> grid = std::make_shared<VersorGrid>();
+    if (!grid->bake(versor, minBox, maxBox, settings.noiseTolerance, NOISE_GRID_MAX_SAMPLES, pool)) return;
+    juliaSet.setNoiseGrid(grid);
+    if (cache) cache->storeVersorGrid(key, grid);
+}
+
+// Edge of the cubic cells of a pass
+static Real voxelEdge(const VEC3F& minBox, const VEC3F& maxBox, const GridResolution& resolution) {
+    VEC3F extent = maxBox - minBox;
+    return std::max({ extent[0] / resolution.nx, extent[1] / resolution.ny, extent[2] / resolution.nz });
+}
+
+void FractalGenerator::planPasses() {
+    // Input bounds grown by the largest noise offset
+    const VEC3F lo = inputMesh.minVert - VEC3F::Constant(settings.alpha);
+    const VEC3F hi = inputMesh.maxVert + VEC3F::Constant(settings.alpha);
+    const Real reach = juliaSet.juliaReach();
+
+    // Per-axis resolution follows the portal-transformed box of every pass
+    auto planPass = [&](size_t portalIdx, unsigned int i) {
+        FractalPass pass;
+        pass.portalIdx = portalIdx;
+        pass.iteration = i;
+
+        // The Julia field can carry the surface past the mesh, but only inside
+        // its reach around the origin
+        VEC3F passLo = lo, passHi = hi;
+        if (settings.juliaBlend > 0.0) {
+            Real margin = juliaSet.juliaSurfaceMargin(portalIdx, i);
+            VEC3F juliaLo = (lo - VEC3F::Constant(margin)).cwiseMax(-reach);
+            VEC3F juliaHi = (hi + VEC3F::Constant(margin)).cwiseMin(reach);
+            if ((juliaLo.array() <= juliaHi.array()).all()) {
+                passLo = passLo.cwiseMin(juliaLo);
+                passHi = passHi.cwiseMax(juliaHi);
+            }
+        }
+        VEC3F bbox[BBOX_SIZE], currBbox[BBOX_SIZE];
+        for (int c = 0; c < BBOX_SIZE; ++c) {
+            bbox[c] = VEC3F((c & 1) ? passHi[0] : passLo[0],
+                            (c & 2) ? passHi[1] : passLo[1],
+                            (c & 4) ? passHi[2] : passLo[2]);
+        }
+
+        // Apply the transformation matrix iteratively through parameter i
+        juliaSet.getPortalMap().getFieldValues(bbox, currBbox, BBOX_SIZE, portalIdx, i);
+        pass.minBox = currBbox[0];
+        pass.maxBox = currBbox[0];
+        for (int c = 1; c < BBOX_SIZE; ++c) {
+            pass.minBox = pass.minBox.cwiseMin(currBbox[c]);
+            pass.maxBox = pass.maxBox.cwiseMax(currBbox[c]);
+        }
+
+        pass.resolution = settings.voxelSize > 0.0
+            ? resolutionFromVoxelSize(pass.minBox, pass.maxBox, settings.voxelSize)
+            : resolutionFromBudget(pass.minBox, pass.maxBox, settings.voxelBudget);
+        return pass;
+    };
+
+    passList.clear();
+    for (size_t portalIdx = 0; portalIdx < juliaSet.getPortalMap().portalTransforms.size(); ++portalIdx) {
+        for (unsigned int i = 1; i <= settings.maxIterations; ++i) {
+            passList.push_back(planPass(portalIdx, i));
+        }
+    }
+
+    // Without iterations there is nothing to mesh separately
+    if (settings.separatePasses) {
+        juliaSet.setCompositeMembers({});
+        return;
+    }
+
+    // One pass over the union of the boxes of the portal copies and the base mesh,
+    // iteration 0, so the copies fuse with the input surface where they overlap.
+    // Without iterations the base mesh is meshed on its own. The grid gets the cell
+    // budget of those passes combined, but no finer cells than the finest of them;
+    // the narrow band keeps sampling near the surface either way.
+    passList.push_back(planPass(0, 0));
+    FractalPass composite;
+    composite.portalIdx = COMPOSITE_FIELD;
+    composite.iteration = settings.maxIterations;
+    composite.minBox = passList[0].minBox;
+    composite.maxBox = passList[0].maxBox;
+    std::vector<std::pair<size_t, size_t>> members;
+    Real finestEdge = std::numeric_limits<Real>::max();
+    for (const FractalPass& pass : passList) {
+        composite.minBox = composite.minBox.cwiseMin(pass.minBox);
+        composite.maxBox = composite.maxBox.cwiseMax(pass.maxBox);
+        members.push_back(std::make_pair(pass.portalIdx, (size_t)pass.iteration));
+        finestEdge = std::min(finestEdge, voxelEdge(pass.minBox, pass.maxBox, pass.resolution));
+    }
+
+    if (settings.voxelSize > 0.0) {
+        composite.resolution = resolutionFromVoxelSize(composite.minBox, composite.maxBox, settings.voxelSize);
+    } else {
+        GridResolution combined = resolutionFromBudget(composite.minBox, composite.maxBox, settings.voxelBudget * passList.size());
+        Real edge = std::max(finestEdge, voxelEdge(composite.minBox, composite.maxBox, combined));
+        composite.resolution = resolutionFromVoxelSize(composite.minBox, composite.maxBox, edge);
+    }
+
+    juliaSet.setCompositeMembers(members);
+    passList.assign(1, composite);
+}
+
+FractalEstimate FractalGenerator::estimate() {
+    const int CALIBRATION_STEPS = 6;
+
+    FractalEstimate result;
+    if (passList.empty()) return result;
+
+    for (const FractalPass& pass : passList) {
+        result.totalSamples += pass.resolution.numSamples();
+        result.peakBytes = std::max(result.peakBytes, pass.resolution.memoryBytes());
+    }
+
+    // Average seconds per field query, timed on a sparse lattice over the first box.
+    // Nothing is prepared: the queries take the input BVH through the portal
+    // transforms, so no portal copy is built on the calling thread, e.g. Maya's.
+    const FractalPass& first = passList[0];
+
+    auto start = std::chrono::steady_clock::now();
+    volatile Real sink = 0;
+    for (int k = 0; k < CALIBRATION_STEPS; ++k) {
+        for (int j = 0; j < CALIBRATION_STEPS; ++j) {
+            for (int i = 0; i < CALIBRATION_STEPS; ++i) {
+                VEC3F t((i + 0.5) / CALIBRATION_STEPS, (j + 0.5) / CALIBRATION_STEPS, (k + 0.5) / CALIBRATION_STEPS);
+                VEC3F point = first.minBox + t.cwiseProduct(first.maxBox - first.minBox);
+                sink = sink + juliaSet.queryFieldValue(point, 4.0, first.portalIdx, first.iteration);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double sampleSeconds = elapsed.count() / (CALIBRATION_STEPS * CALIBRATION_STEPS * CALIBRATION_STEPS);
+    result.seconds = sampleSeconds * result.totalSamples / pool.size();
+    return result;
+}
+
+bool FractalGenerator::generate(const PassCallback& onPass, JobProgress* progress) {
+    Mesh fractalMesh;
+    fractalMesh.fromMesh(inputMesh);
+
+    for (size_t p = 0; p < passList.size(); ++p) {
+        if (progress) {
+            if (progress->cancelled()) return false;
+            progress->beginPass(p, passList.size());
+        }
+
+        Profile profile;
+        meshPass(passList[p], fractalMesh, &profile, progress);
+        if (progress && progress->cancelled()) return false;
+        onPass(passList[p], fractalMesh, profile);
+    }
+
+    if (progress) progress->finish();
+    return true;
+}
+
+std::future<bool> FractalGenerator::generateAsync(PassCallback onPass, JobProgress* progress) {
+    return std::async(std::launch::async, [this, onPass, progress]() {
+        return generate(onPass, progress);
+    });
+}
+
+void FractalGenerator::meshPass(const FractalPass& pass, Mesh& mesh, Profile* profile, JobProgress* progress) {
+    uint64_t key = 0;
+    if (cache) {
+        ScopedTimer timer(profile, "cache");
+        key = passKey(pass);
+        std::shared_ptr<const Mesh> cached = cache->findMesh(key);
+        if (cached) {
+            mesh.vertices = cached->vertices;
+            mesh.normals = cached->normals;
+            mesh.indices = cached->indices;
+            return;
+        }
+    }
+
+    // Portal copy BVHs one at a time, so a cancel does not wait for all of them
+    {
+        ScopedTimer timer(profile, "bvh");
+        prepareIteration(pass, progress);
+    }
+    if (progress && progress->cancelled()) return;
+    prepareNoise(profile);
+
+    if (settings.useDualContouring) {
+        DualContouring(mesh, juliaSet, pass.minBox, pass.maxBox, pass.portalIdx, pass.iteration, pass.resolution, pool, settings.simplifyError, profile, progress);
+    } else {
+        MarchingCubes(mesh, juliaSet, pass.minBox, pass.maxBox, pass.portalIdx, pass.iteration, pass.resolution, pool, profile, progress);
+    }
+
+    // An interrupted pass is incomplete and must not be reused
+    if (cache && !(progress && progress->cancelled())) {
+        std::shared_ptr<Mesh> geometry = std::make_shared<Mesh>();
+        geometry->vertices = mesh.vertices;
+        geometry->normals = mesh.normals;
+        geometry->indices = mesh.indices;
+        cache->storeMesh(key, geometry);
+    }
+}
+
+std::string describePass(const FractalPass& pass) {
+    if (pass.isComposite()) {
+        if (pass.iteration == 0) return "input mesh";
+        return "all portals to iteration " + std::to_string(pass.iteration);
+    }
+    return "portal " + std::to_string(pass.portalIdx) + " iteration " + std::to_string(pass.iteration);
+}
+
+bool writeProfileReport(const std::string& path, const std::vector<FractalPass>& passes, const std::vector<Profile>& profiles, std::string* error) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        *error = "cannot write " + path;
+        return false;
+    }
+
+    std::fprintf(file, "[\n");
+    size_t count = std::min(passes.size(), profiles.size());
+    for (size_t i = 0; i < count; ++i) {
+        const FractalPass& pass = passes[i];
+        // The composite pass covers every portal, reported as null
+        std::string portal = pass.isComposite() ? "null" : std::to_string(pass.portalIdx);
+        std::fprintf(file, "  {\"portal\": %s, \"iteration\": %u, \"resolution\": [%d, %d, %d], \"profile\": %s}%s\n",
+                     portal.c_str(), pass.iteration, pass.resolution.nx, pass.resolution.ny, pass.resolution.nz,
+                     profiles[i].toJson().c_str(), i + 1 < count ? "," : "");
+    }
+    std::fprintf(file, "]\n");
+
+    if (std::fclose(file) != 0) {
+        *error = "failed writing " + path;
+        return false;
+    }
+    return true;
+}
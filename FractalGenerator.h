@@ -0,0 +1,140 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "FractalCache.h"
+#include "JuliaSet.h"
+#include "MarchingCubes.h"
+#include "mesh.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Everything FractalCmd and the command line driver pass to the generator
+struct FractalSettings {
+    // Portal transform
+    double posX = 0.0, posY = 0.0, posZ = 0.0;
+    double rotX = 0.0, rotY = 0.0, rotZ = 0.0;      // degrees
+    double scaleX = 1.0, scaleY = 1.0, scaleZ = 1.0;
+
+    double alpha = 0.0;             // noise amplitude
+    double beta = 0.0;              // noise offset
+    double versorScale = 1.0;
+    unsigned int versorOctave = 1u;
+    unsigned int maxIterations = 2u;
+
+    // Grid resolution: an explicit voxel size wins over a voxel budget. Low res
+    // caps the budget at 10^3 cells.
+    bool isLowRes = false;
+    double voxelSize = 0.0;
+    size_t voxelBudget = 50 * 50 * 50;
+
+    bool useDualContouring = false;
+    double simplifyError = 0.1;     // dual contouring only, in finest cells
+
+    // Mesh every portal copy on its own instead of their union in one pass
+    bool separatePasses = false;
+
+    // Read the noise from a grid baked once per noise setting instead of evaluating
+    // every octave per query, within noiseTolerance per channel of exact evaluation
+    bool bakeNoise = false;
+    double noiseTolerance = 0.01;
+
+    // Blend of the quaternion Julia distance estimate into the mesh field, 0 for the
+    // mesh alone and 1 for the Julia set alone. juliaScale is the input space size of
+    // one Julia unit, juliaIterations the orbit length.
+    double juliaBlend = 0.0;
+    double juliaScale = 1.0;
+    unsigned int juliaIterations = 12u;
+
+    unsigned int numThreads = 0;    // 0 = use all hardware threads
+
+    // Clamp parameters to their supported ranges
+    void validate();
+};
+
+// One meshing pass: a portal at one iteration, over its transformed bounding box,
+// or the union of every portal copy (portalIdx COMPOSITE_FIELD, iteration the
+// deepest one) over the union of their boxes
+struct FractalPass {
+    size_t portalIdx;
+    unsigned int iteration;
+    VEC3F minBox, maxBox;
+    GridResolution resolution;
+
+    bool isComposite() const { return portalIdx == COMPOSITE_FIELD; }
+};
+
+// "portal 0 iteration 2", or "all portals to iteration 2" for the composite pass
+// ("input mesh" without iterations)
+std::string describePass(const FractalPass& pass);
+
+// Up-front cost of a generation
+struct FractalEstimate {
+    size_t totalSamples = 0;
+    size_t peakBytes = 0;           // largest sample grid of any pass
+    double seconds = 0.0;           // field queries only, spread over the pool
+};
+
+// The fractal pipeline without any host application: builds the portal map and
+// Julia set for an input mesh, plans the passes and meshes them. By default all
+// portal copies are united into a single composite pass. With a cache,
+// portal copy BVHs, baked noise and pass meshes are reused from earlier generators whose
+// inputs match, and stored for later ones.
+class FractalGenerator {
+public:
+    FractalGenerator(const Mesh& input, const FractalSettings& settings, FractalCache* cache = nullptr);
+
+    // Empty only with separate passes and no iterations, i.e. nothing to mesh
+    const std::vector<FractalPass>& passes() const { return passList; }
+    unsigned int numThreads() const { return pool.size(); }
+    JuliaSet& julia() { return juliaSet; }
+    ThreadPool& threadPool() { return pool; }
+
+    // Times a few field queries of the first pass and extrapolates to every sample.
+    // Builds no BVH, so it stays quick on the UI thread whatever the input size.
+    FractalEstimate estimate();
+
+    typedef std::function<void(const FractalPass&, const Mesh&, Profile&)> PassCallback;
+
+    // Meshes every pass in order. The mesh handed to onPass carries the input UVs
+    // and is reused by the next pass. The profile holds the mesher stages of the
+    // pass; onPass may time its own stages into it. Reports to progress if given and
+    // returns false, without calling onPass for the interrupted pass, once it is
+    // cancelled.
+    bool generate(const PassCallback& onPass, JobProgress* progress = nullptr);
+
+    // generate on a background thread, which also runs onPass. The generator and
+    // progress must outlive the returned future.
+    std::future<bool> generateAsync(PassCallback onPass, JobProgress* progress = nullptr);
+
+    // Meshes a single pass into mesh, replacing its geometry
+    void meshPass(const FractalPass& pass, Mesh& mesh, Profile* profile = nullptr, JobProgress* progress = nullptr);
+
+private:
+    void planPasses();
+
+    // Builds the portal copy BVHs of a pass, or takes them from the cache
+    void prepareIteration(const FractalPass& pass, JobProgress* progress = nullptr);
+    void prepareIteration(size_t portalIdx, unsigned int iteration);
+    uint64_t iterationKey(size_t portalIdx, unsigned int iteration);
+    uint64_t passKey(const FractalPass& pass);
+
+    // Bakes the noise grid if asked for, or takes it from the cache
+    void prepareNoise(Profile* profile);
+
+    FractalSettings settings;
+    Mesh inputMesh;
+    JuliaSet juliaSet;
+    ThreadPool pool;
+    std::vector<FractalPass> passList;
+
+    FractalCache* cache;
+    uint64_t inputKey = 0;          // input geometry
+    bool noisePrepared = false;
+};
+
+// Writes one JSON object per pass: portal, iteration, resolution and its profile
+bool writeProfileReport(const std::string& path, const std::vector<FractalPass>& passes, const std::vector<Profile>& profiles, std::string* error);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+// Progress and cancellation shared between a running generation and whoever
+// watches it from another thread. The generator marks each pass, the mesher
+// splits a pass into steps (grid slabs, octree bricks) and polls cancelled()
+// between them. Reads are for display only and may be momentarily inconsistent.
+class JobProgress {
+public:
+    void cancel() { cancelFlag = true; }
+    bool cancelled() const { return cancelFlag.load(std::memory_order_relaxed); }
+
+    void beginPass(size_t pass, size_t numPasses) {
+        stepsDone = 0;
+        stepsTotal = 0;
+        passCount = numPasses;
+        currentPass = pass;
+    }
+    void setSteps(size_t total) { stepsDone = 0; stepsTotal = total; }
+    void step(size_t count = 1) { stepsDone.fetch_add(count, std::memory_order_relaxed); }
+    void finish() { currentPass = passCount.load(); stepsTotal = 0; }
+
+    size_t pass() const { return currentPass; }
+    size_t numPasses() const { return passCount; }
+
+    // Whole job done, from 0 to 1
+    float fraction() const {
+        size_t passes = passCount;
+        if (passes == 0) return 0.0f;
+        size_t total = stepsTotal;
+        float inPass = total > 0 ? std::min(1.0f, (float)stepsDone / (float)total) : 0.0f;
+        return std::min(1.0f, ((float)currentPass + inPass) / (float)passes);
+    }
+
+private:
+    std::atomic<bool> cancelFlag{ false };
+    std::atomic<size_t> currentPass{ 0 };
+    std::atomic<size_t> passCount{ 0 };
+    std::atomic<size_t> stepsDone{ 0 };
+    std::atomic<size_t> stepsTotal{ 0 };
+};
@@ -1,176 +1,475 @@
 #include "JuliaSet.h"
+#include <algorithm>
 #include <cmath>
+#include <limits>
+
+#include "Profiler.h"
+#include "SimdLanes.h"
+
+// Distance to the closest point, relative to the magnitude of the query position,
+// below which the direction to it is mostly rounding error
+#define GRADIENT_MIN_DISTANCE (1e3 * std::numeric_limits<Real>::epsilon())
+// Distance estimate at which the Julia surface is taken, in Julia units
+#define JULIA_SURFACE_OFFSET 0.02
+// Largest distance estimate the Julia field tells apart, in Julia units. The field
+// is flat farther out, which bounds how far it moves the blended surface and so
+// keeps the narrow band tight.
+#define JULIA_FIELD_RANGE 0.1
+// Central difference step of the Julia field gradient, in Julia units
+#define JULIA_GRADIENT_STEP std::cbrt(std::numeric_limits<Real>::epsilon())
+
+// Radius past which every orbit of q <- q^2 + c grows without bound, since there
+// |q^2 + c| >= |q|^2 - |c| > |q|
+static Real juliaEscapeBound(const QUATERNION& c) {
+    return 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * c.magnitude()));
+}
+
+// Quaternion Julia distance estimate at count points of Julia space, with w = 0:
+// iterates q <- q^2 + c and |q'| <- 2 |q| |q'| until |q| passes escapeRadius, then
+// takes 0.5 |q| log|q| / |q'|. The surface is where the estimate falls to
+// JULIA_SURFACE_OFFSET, so it is sampled where the estimate is smooth; orbits
+// that stay within the escape bound are inside at that same value. Positive
+// inside like the mesh field, never below -JULIA_FIELD_RANGE, and negative past
+// the escape bound.
+static void juliaDistanceEstimates(const VEC3F* pos, Real invScale, Real* out, size_t count,
+                                   const QUATERNION& c, int iterations, Real escapeRadius) {
+    const Lanes cw = Lanes::set(c[3]), cx = Lanes::set(c[0]), cy = Lanes::set(c[1]), cz = Lanes::set(c[2]);
+    const Lanes two = Lanes::set(2.0), four = Lanes::set(4.0);
+    const Lanes escape2 = Lanes::set(escapeRadius * escapeRadius);
+    const Real bound = juliaEscapeBound(c);
+    const Real inner = std::min(bound, escapeRadius);
+
+    for (size_t start = 0; start < count; start += SIMD_LANES) {
+        const size_t lanes = std::min<size_t>(SIMD_LANES, count - start);
+
+        // Unused lanes start past the escape radius and never iterate
+        Real px[SIMD_LANES], py[SIMD_LANES], pz[SIMD_LANES];
+        for (int l = 0; l < SIMD_LANES; ++l) {
+            VEC3F p = (size_t)l < lanes ? VEC3F(pos[start + l] * invScale) : VEC3F(2.0 * escapeRadius, 0.0, 0.0);
+            px[l] = p[0];
+            py[l] = p[1];
+            pz[l] = p[2];
+        }
+        Lanes w = Lanes::set(0.0), x = Lanes::load(px), y = Lanes::load(py), z = Lanes::load(pz);
+        Lanes r2 = x * x + y * y + z * z;
+        Lanes dr2 = Lanes::set(1.0);
+
+        // Escaped lanes keep their last values. |q'| is carried squared to keep the
+        // loop free of square roots.
+        for (int i = 0; i < iterations; ++i) {
+            LaneMask iterate = lessEqual(r2, escape2);
+            if (!anyLane(iterate)) break;
+            // Same step as QUATERNION::juliaIteration
+            Lanes nw = w * w - x * x - y * y - z * z + cw;
+            Lanes nx = two * w * x + cx;
+            Lanes ny = two * w * y + cy;
+            Lanes nz = two * w * z + cz;
+            dr2 = select(iterate, four * r2 * dr2, dr2);
+            r2 = select(iterate, nw * nw + nx * nx + ny * ny + nz * nz, r2);
+            w = select(iterate, nw, w);
+            x = select(iterate, nx, x);
+            y = select(iterate, ny, y);
+            z = select(iterate, nz, z);
+        }
+
+        Real orbitR2[SIMD_LANES], orbitDr2[SIMD_LANES];
+        r2.store(orbitR2);
+        dr2.store(orbitDr2);
+        for (size_t l = 0; l < lanes; ++l) {
+            const Real r = std::sqrt(orbitR2[l]);
+            const Real estimate = 0.5 * r * std::log(r) / std::sqrt(std::max(orbitDr2[l], std::numeric_limits<Real>::min()));
+            const Real value = r > inner ? JULIA_SURFACE_OFFSET - estimate : JULIA_SURFACE_OFFSET;
+            out[start + l] = std::max<Real>(std::min(value, bound - std::sqrt(px[l] * px[l] + py[l] * py[l] + pz[l] * pz[l])), -JULIA_FIELD_RANGE);
+        }
+    }
+}
 
 JuliaSet::JuliaSet(unsigned int maxIter = 10u, double maxMag = 4.0, double alpha_ = 1.0, double beta_ = 0.0, const QUATERNION& c = QUATERNION(0.0, 0.5, 0.0, 0.0), Versor versor = Versor())
-    : maxIterations(maxIter), maxMagnitude(maxMag), alpha(alpha_), beta(beta_), c(c), noise(versor) {
+    : maxIterations(maxIter), maxMagnitude(maxMag), c(c), noise(versor), alpha(alpha_), beta(beta_) {
     pm = PortalMap();
 }
 
+// Whether every edge is shared by exactly two triangles
+static bool isClosed(const std::vector<uint>& indices) {
+    std::vector<uint64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (int e = 0; e < 3; ++e) {
+            uint64_t a = indices[i + e], b = indices[i + (e + 1) % 3];
+            edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); ) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) ++j;
+        if (j - i != 2) return false;
+        i = j;
+    }
+    return !edges.empty();
+}
+
 void JuliaSet::setInputMesh(const Mesh& mesh) {
     // Store the input mesh for distance field calculations
     inputMesh = mesh;
     hasMesh = true;
-}
 
-// Helper function: compute closest point on triangle ABC to point P
-static VEC3F closestPointOnTriangle(const VEC3F& p, const VEC3F& a, const VEC3F& b, const VEC3F& c) {
-    // Compute edges
-    VEC3F ab = b - a;
-    VEC3F ac = c - a;
-    VEC3F ap = p - a;
+    // Acceleration structure for closest-point queries
+    bvh.build(inputMesh.vertices, inputMesh.indices);
+    inputClosed = isClosed(inputMesh.indices);
+    clearIterations();
+}
 
-    // Compute dot products
-    Real d1 = ab.dot(ap);
-    Real d2 = ac.dot(ap);
+void JuliaSet::prepareIteration(size_t idx, size_t num_iter) {
+    if (idx == COMPOSITE_FIELD) {
+        compositeBoxes.clear();
+        for (const auto& member : compositeMembers) {
+            prepareIteration(member.first, member.second);
+        }
 
-    // Check if P in vertex region outside A
-    if (d1 <= 0 && d2 <= 0) return a;
+        // A flat list is the box index: there are only portals x iterations members
+        std::vector<CompositeBox> boxes(compositeMembers.size());
+        for (size_t m = 0; m < compositeMembers.size(); ++m) {
+            std::shared_ptr<const MeshBVH> memberBvh = iterationBVH(compositeMembers[m].first, compositeMembers[m].second);
+            if (!memberBvh || !memberBvh->bounds(&boxes[m].boxMin, &boxes[m].boxMax)) return;
+            boxes[m].perturbation = fieldPerturbationBound(compositeMembers[m].first, compositeMembers[m].second);
+        }
+        compositeBoxes.swap(boxes);
+        return;
+    }
 
-    // Check if P in vertex region outside B
-    VEC3F bp = p - b;
-    Real d3 = ab.dot(bp);
-    Real d4 = ac.dot(bp);
-    if (d3 >= 0 && d4 <= d3) return b;
+    pm.precomputeTransforms(idx, num_iter);
+    if (!hasMesh) return;
 
-    // Check if P in edge region of AB
-    Real vc = d1 * d4 - d3 * d2;
-    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
-        Real v = d1 / (d1 - d3);
-        return a + ab * v;
-    }
+    std::pair<size_t, size_t> key(idx, num_iter);
+    if (iterationMeshes.count(key)) return;
 
-    // Check if P in vertex region outside C
-    VEC3F cp = p - c;
-    Real d5 = ab.dot(cp);
-    Real d6 = ac.dot(cp);
-    if (d6 >= 0 && d5 <= d6) return c;
+    // The portal copy of the mesh in world space
+    std::vector<VEC3F> transformed(inputMesh.vertices.size());
+    pm.getFieldValues(inputMesh.vertices.data(), transformed.data(), transformed.size(), idx, num_iter);
 
-    // Check if P in edge region of AC
-    Real vb = d5 * d2 - d1 * d6;
-    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
-        Real w = d2 / (d2 - d6);
-        return a + ac * w;
+    // A mirroring transform flips the winding, which would turn the pseudo-normals inwards
+    std::vector<uint> indices = inputMesh.indices;
+    if (pm.getTransform(idx, num_iter).block<3, 3>(0, 0).determinant() < 0.0) {
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            std::swap(indices[i + 1], indices[i + 2]);
+        }
     }
 
-    // Check if P in edge region of BC
-    Real va = d3 * d6 - d5 * d4;
-    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
-        Real w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
-        return b + (c - b) * w;
-    }
+    std::shared_ptr<MeshBVH> iterationBvh = std::make_shared<MeshBVH>();
+    iterationBvh->build(transformed, indices);
+    iterationMeshes[key] = iterationBvh;
+}
 
-    // P inside face region. Compute barycentric coordinates (u, v, w)
-    Real denom = 1.0 / (va + vb + vc);
-    Real v = vb * denom;
-    Real w = vc * denom;
-    return a + ab * v + ac * w;
+void JuliaSet::clearIterations() {
+    iterationMeshes.clear();
+    compositeBoxes.clear();
 }
 
-VEC3F JuliaSet::computeClosestPointOnMesh(const VEC3F& point, size_t idx, size_t num_iter) const {
-    if (!hasMesh) return VEC3F(); // Return (0,0,0) if no mesh is available
+std::shared_ptr<const MeshBVH> JuliaSet::iterationBVH(size_t idx, size_t num_iter) const {
+    auto it = iterationMeshes.find(std::make_pair(idx, num_iter));
+    return it != iterationMeshes.end() ? it->second : nullptr;
+}
 
-    VEC3F closestPoint;
-    Real minDistance = std::numeric_limits<Real>::max();
+void JuliaSet::setIterationBVH(size_t idx, size_t num_iter, std::shared_ptr<const MeshBVH> iterationBvh) {
+    iterationMeshes[std::make_pair(idx, num_iter)] = iterationBvh;
+}
 
-    for (size_t i = 0; i < inputMesh.indices.size(); i += 3) {
-        unsigned int idx1 = inputMesh.indices[i];
-        unsigned int idx2 = inputMesh.indices[i + 1];
-        unsigned int idx3 = inputMesh.indices[i + 2];
+bool JuliaSet::closestHitOnMesh(const VEC3F& point, size_t idx, size_t num_iter, MeshBVH::ClosestHit* hit) const {
+    if (!hasMesh) return false;
 
-        const VEC3F& v1 = inputMesh.vertices[idx1];
-        const VEC3F& v2 = inputMesh.vertices[idx2];
-        const VEC3F& v3 = inputMesh.vertices[idx3];
+    auto it = iterationMeshes.find(std::make_pair(idx, num_iter));
+    if (it != iterationMeshes.end()) {
+        return it->second->closestPoint(point, hit);
+    }
 
+    // Not prepared: the mesh is mapped through the portal transform, applied lazily
+    // to the BVH nodes and triangles visited by the query
+    return bvh.closestPoint(point, pm.getTransform(idx, num_iter), hit);
+}
 
-        VEC3F v1T, v2T, v3T;
+VEC3F JuliaSet::computeClosestPointOnMesh(const VEC3F& point, size_t idx, size_t num_iter) const {
+    MeshBVH::ClosestHit hit;
+    if (!closestHitOnMesh(point, idx, num_iter, &hit)) return VEC3F::Zero(); // Return (0,0,0) if no mesh is available
 
-        v1T = pm.getInvFieldValue(v1, idx, num_iter);
-        v2T = pm.getInvFieldValue(v2, idx, num_iter);
-        v3T = pm.getInvFieldValue(v3, idx, num_iter);
+    return hit.point;
+}
 
+Real JuliaSet::computeSignedDistanceToMesh(const VEC3F& point, size_t idx, size_t num_iter) const {
+    MeshBVH::ClosestHit hit;
+    if (!closestHitOnMesh(point, idx, num_iter, &hit)) return 0.0;
 
-        VEC3F candidate = closestPointOnTriangle(point, v1T, v2T, v3T);
-        Real distance = (candidate - point).norm();
+    // Inside/outside from the pseudo-normal of the closest feature, found by the same query
+    return MeshBVH::signedDistance(point, hit);
+}
 
-        if (distance < minDistance) {
-            minDistance = distance;
-            closestPoint = candidate;
-        }
-    }
+VEC3F JuliaSet::noiseDirection(const VEC3F& noisePos) const {
+    // Points the grid does not cover, far outside the input mesh, are evaluated exactly
+    if (noiseGrid && noiseGrid->contains(noisePos)) return noiseGrid->getFieldValue(noisePos);
+    return noise.getFieldValue(noisePos);
+}
 
-    return closestPoint;
+void JuliaSet::juliaFieldValues(const VEC3F* origPts, Real* values, size_t count) const {
+    juliaDistanceEstimates(origPts, 1.0 / juliaScale, values, count, c, maxIterations, maxMagnitude);
 }
 
-bool rayIntersectsTriangle(const VEC3F& origin, const VEC3F& dir,
-    const VEC3F& v0, const VEC3F& v1, const VEC3F& v2) {
-    const float EPSILON = 1e-6f;
+Real JuliaSet::juliaUnit(size_t idx, size_t num_iter) const {
+    // Julia units follow the portal transform's change of volume
+    Matrix<Real, 3, 3> linear = pm.getTransform(idx, num_iter).topLeftCorner<3, 3>();
+    return juliaScale * std::cbrt(std::abs(linear.determinant()));
+}
 
-    VEC3F edge1 = v1 - v0;
-    VEC3F edge2 = v2 - v0;
-    VEC3F h = dir.cross(edge2);
-    float a = edge1.dot(h);
+Real JuliaSet::queryFieldValue(const VEC3F& point, double escapeRadius, size_t idx, size_t num_iter) const {
+    // Perturb the current position by perlin noise. Approximately simulating 
+    // perturbed mesh surface without actually editing the mesh. The noise is
+    // evaluated at the equivalent point of the original mesh so every portal
+    // copy carries the same (scaled) detail.
+    if (idx == COMPOSITE_FIELD) return queryCompositeFieldValue(point, escapeRadius);
+
+    profileCount(PROFILE_FIELD_QUERIES);
+    VEC3F origPt = pm.getInvFieldValue(point, idx, num_iter);
+    Real julia = 0.0;
+    if (juliaBlend > 0.0) {
+        juliaFieldValues(&origPt, &julia, 1);
+        julia *= juliaUnit(idx, num_iter);
+        // The Julia set alone needs no mesh distance
+        if (juliaBlend == 1.0) return julia;
+    }
 
-    if (a > -EPSILON && a < EPSILON)
-        return false; // Ray is parallel
+    VEC3F currPos = origPt + alpha * noiseDirection(origPt + VEC3F(beta, beta, beta));
+    // Calculate signed distance to the portal copy, in world units
+    Real value = computeSignedDistanceToMesh(pm.getFieldValue(currPos, idx, num_iter), idx, num_iter);
+    if (juliaBlend == 0.0) return value;
+    return (1.0 - juliaBlend) * value + juliaBlend * julia;
+}
 
-    float f = 1.0 / a;
-    VEC3F s = origin - v0;
-    float u = f * s.dot(h);
-    if (u < 0.0 || u > 1.0)
-        return false;
+Real JuliaSet::juliaValueAndGradient(const VEC3F& origPt, size_t idx, size_t num_iter, VEC3F* gradient) const {
+    // The estimate only tracks the length of the orbit's derivative, not its
+    // direction, so the gradient is differenced, in the same batch as the value
+    const Real step = JULIA_GRADIENT_STEP * juliaScale;
+    VEC3F samples[7];
+    samples[6] = origPt;
+    for (int axis = 0; axis < 3; ++axis) {
+        samples[2 * axis] = origPt;
+        samples[2 * axis][axis] += step;
+        samples[2 * axis + 1] = origPt;
+        samples[2 * axis + 1][axis] -= step;
+    }
+    Real julia[7];
+    juliaFieldValues(samples, julia, 7);
+    VEC3F inputGradient(julia[0] - julia[1], julia[2] - julia[3], julia[4] - julia[5]);
+
+    // origPt = T^-1 point with T affine
+    const Real unit = juliaUnit(idx, num_iter);
+    Matrix<Real, 3, 3> inverse = pm.getInvTransform(idx, num_iter).topLeftCorner<3, 3>();
+    *gradient = inverse.transpose() * inputGradient * (unit / (2.0 * step));
+    return unit * julia[6];
+}
 
-    VEC3F q = s.cross(edge1);
-    float v = f * dir.dot(q);
-    if (v < 0.0 || u + v > 1.0)
-        return false;
+Real JuliaSet::queryFieldValueAndGradient(const VEC3F& point, VEC3F* gradient, size_t idx, size_t num_iter) const {
+    if (idx == COMPOSITE_FIELD) return queryCompositeFieldValueAndGradient(point, gradient);
+
+    // Same steps as queryFieldValue, keeping the derivative of each
+    profileCount(PROFILE_FIELD_QUERIES);
+    VEC3F origPt = pm.getInvFieldValue(point, idx, num_iter);
+    Real julia = 0.0;
+    VEC3F juliaGradient = VEC3F::Zero();
+    if (juliaBlend > 0.0) {
+        julia = juliaValueAndGradient(origPt, idx, num_iter, &juliaGradient);
+        if (juliaBlend == 1.0) {
+            *gradient = juliaGradient;
+            return julia;
+        }
+    }
 
-    float t = f * edge2.dot(q);
-    if (t > EPSILON)
-        return true;
+    Matrix<Real, 3, 3> noiseJacobian;
+    VEC3F currPos = origPt + alpha * noise.getFieldValueAndJacobian(origPt + VEC3F(beta, beta, beta), &noiseJacobian);
+    VEC3F meshPos = pm.getFieldValue(currPos, idx, num_iter);
 
-    return false;
+    MeshBVH::ClosestHit hit;
+    if (!closestHitOnMesh(meshPos, idx, num_iter, &hit)) {
+        *gradient = VEC3F::Zero();
+        return 0.0;
+    }
+    Real value = MeshBVH::signedDistance(meshPos, hit);
+
+    // The signed distance grows fastest away from the closest point inside and
+    // towards it outside; on the surface, where rounding swamps that direction,
+    // against the pseudo-normal
+    VEC3F distanceGradient = hit.distance > GRADIENT_MIN_DISTANCE * meshPos.norm()
+        ? VEC3F((meshPos - hit.point) / (value > 0.0 ? hit.distance : -hit.distance))
+        : VEC3F(-hit.normal.normalized());
+
+    // meshPos = T (T^-1 point + alpha * noise), with T affine
+    Matrix<Real, 3, 3> forward = pm.getTransform(idx, num_iter).topLeftCorner<3, 3>();
+    Matrix<Real, 3, 3> inverse = pm.getInvTransform(idx, num_iter).topLeftCorner<3, 3>();
+    Matrix<Real, 3, 3> chain = forward * (Matrix<Real, 3, 3>::Identity() + alpha * noiseJacobian) * inverse;
+    *gradient = chain.transpose() * distanceGradient;
+    if (juliaBlend == 0.0) return value;
+
+    *gradient = (1.0 - juliaBlend) * *gradient + juliaBlend * juliaGradient;
+    return (1.0 - juliaBlend) * value + juliaBlend * julia;
 }
 
-bool JuliaSet::isPointInsideMesh(const VEC3F& point) const {
-    VEC3F rayDir = VEC3F(1.0f, 0.5f, 0.25f); // Avoid axis-aligned
-    rayDir.normalize();
-    VEC3F origin = point + rayDir * 1e-3f;   // Offset origin slightly
+void JuliaSet::queryFieldValues(const VEC3F* points, Real* values, size_t count, size_t idx, size_t num_iter) const {
+    // Composite members are picked per point
+    if (idx == COMPOSITE_FIELD) {
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = queryCompositeFieldValue(points[i], 4.0);
+        }
+        return;
+    }
 
-    int intersectionCount = 0;
+    // Same steps as queryFieldValue, a stage at a time
+    profileCount(PROFILE_FIELD_QUERIES, count);
+    static thread_local std::vector<VEC3F> origPts, offsets;
+    static thread_local std::vector<Real> julia;
+    origPts.resize(count);
+    offsets.resize(count);
+    pm.getInvFieldValues(points, origPts.data(), count, idx, num_iter);
+    if (juliaBlend == 1.0) {
+        juliaFieldValues(origPts.data(), values, count);
+        const Real unit = juliaUnit(idx, num_iter);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] *= unit;
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = origPts[i] + VEC3F(beta, beta, beta);
+    }
+    if (noiseGrid) {
+        for (size_t i = 0; i < count; ++i) {
+            offsets[i] = noiseDirection(offsets[i]);
+        }
+    } else {
+        noise.getFieldValues(offsets.data(), offsets.data(), count);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        VEC3F currPos = origPts[i] + alpha * offsets[i];
+        values[i] = computeSignedDistanceToMesh(pm.getFieldValue(currPos, idx, num_iter), idx, num_iter);
+    }
+    if (juliaBlend == 0.0) return;
+
+    julia.resize(count);
+    juliaFieldValues(origPts.data(), julia.data(), count);
+    const Real unit = juliaUnit(idx, num_iter);
+    for (size_t i = 0; i < count; ++i) {
+        Real scaled = julia[i] * unit;
+        values[i] = (1.0 - juliaBlend) * values[i] + juliaBlend * scaled;
+    }
+}
 
-    for (size_t i = 0; i < inputMesh.indices.size(); i += 3) {
-        const VEC3F& v0 = inputMesh.vertices[inputMesh.indices[i]];
-        const VEC3F& v1 = inputMesh.vertices[inputMesh.indices[i + 1]];
-        const VEC3F& v2 = inputMesh.vertices[inputMesh.indices[i + 2]];
+const std::vector<std::pair<Real, size_t>>& JuliaSet::compositeOrder(const VEC3F& point) const {
+    // A closed portal copy lies in its box, so its signed distance never exceeds the
+    // box's: outside, the copy is at least the box distance away; inside, the way
+    // out to the nearest face crosses its surface. The mesh distance is weighted down
+    // by the Julia blend, and the noise and Julia field move the result by at most
+    // the perturbation bound on top. Members go from the highest bound down.
+    // An open copy can read inside well away from its box, so it has no bound and
+    // is always evaluated.
+    static thread_local std::vector<std::pair<Real, size_t>> order;
+    order.clear();
+    for (size_t m = 0; m < compositeBoxes.size(); ++m) {
+        if (!inputClosed && juliaBlend < 1.0) {
+            order.push_back(std::make_pair(std::numeric_limits<Real>::infinity(), m));
+            continue;
+        }
+        const CompositeBox& box = compositeBoxes[m];
+        VEC3F below = box.boxMin - point;
+        VEC3F above = point - box.boxMax;
+        Real boxDistance = below.cwiseMax(above).cwiseMax(0.0).norm();
+        if (boxDistance == 0.0) {
+            boxDistance = below.cwiseMax(above).maxCoeff();    // minus the depth inside
+        }
+        order.push_back(std::make_pair(box.perturbation - (1.0 - juliaBlend) * boxDistance, m));
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<Real, size_t>& a, const std::pair<Real, size_t>& b) {
+        return a.first > b.first;
+    });
+    return order;
+}
 
-        if (rayIntersectsTriangle(origin, rayDir, v0, v1, v2)) {
-            intersectionCount++;
+Real JuliaSet::queryCompositeFieldValue(const VEC3F& point, double escapeRadius) const {
+    // Positive inside, so the union is the maximum
+    Real value = -std::numeric_limits<Real>::infinity();
+    if (compositeBoxes.size() != compositeMembers.size()) {
+        for (const auto& member : compositeMembers) {
+            value = std::max(value, queryFieldValue(point, escapeRadius, member.first, member.second));
         }
+        return value;
     }
 
-    return (intersectionCount % 2) == 1;
+    // Stop once the next member's bound cannot beat the running maximum
+    for (const auto& entry : compositeOrder(point)) {
+        if (entry.first <= value) break;
+        const auto& member = compositeMembers[entry.second];
+        value = std::max(value, queryFieldValue(point, escapeRadius, member.first, member.second));
+    }
+    return value;
 }
 
+Real JuliaSet::queryCompositeFieldValueAndGradient(const VEC3F& point, VEC3F* gradient) const {
+    // The gradient of the maximum is that of the member attaining it
+    Real value = -std::numeric_limits<Real>::infinity();
+    *gradient = VEC3F::Zero();
+    auto visit = [&](const std::pair<size_t, size_t>& member) {
+        VEC3F memberGradient;
+        Real memberValue = queryFieldValueAndGradient(point, &memberGradient, member.first, member.second);
+        if (memberValue > value) {
+            value = memberValue;
+            *gradient = memberGradient;
+        }
+    };
 
-Real JuliaSet::computeSignedDistanceToMesh(const VEC3F& point, size_t idx, size_t num_iter) const {
-    if (!hasMesh) return 0.0;
+    if (compositeBoxes.size() != compositeMembers.size()) {
+        for (const auto& member : compositeMembers) visit(member);
+        return value;
+    }
+    for (const auto& entry : compositeOrder(point)) {
+        if (entry.first <= value) break;
+        visit(compositeMembers[entry.second]);
+    }
+    return value;
+}
 
-    // First, compute the closest point on the mesh
-    VEC3F closestPoint = computeClosestPointOnMesh(point, idx, num_iter);
-    Real unsignedDistance = (point - closestPoint).norm();
+Real JuliaSet::fieldPerturbationBound(size_t idx, size_t num_iter) const {
+    // The maximum of fields each moved by at most b_i moves by at most max b_i
+    if (idx == COMPOSITE_FIELD) {
+        Real bound = 0.0;
+        for (const auto& member : compositeMembers) {
+            bound = std::max(bound, fieldPerturbationBound(member.first, member.second));
+        }
+        return bound;
+    }
 
-    // Determine if point is inside using ray casting
-    bool isInside = isPointInsideMesh(point);
+    // The noise offset has unit length before the portal transform, which
+    // stretches it by at most the largest singular value of its linear part
+    Matrix<Real, 3, 3> linear = pm.getTransform(idx, num_iter).topLeftCorner<3, 3>();
+    JacobiSVD<Matrix<Real, 3, 3>> svd(linear);
+    Real noiseBound = std::abs(alpha) * svd.singularValues()[0];
+    if (juliaBlend == 0.0) return noiseBound;
 
-    return isInside ? unsignedDistance : -unsignedDistance;
+    // The blend is a weighted mean: the mesh part keeps a Lipschitz constant of at
+    // most 1, and the Julia part never leaves JULIA_FIELD_RANGE Julia units of 0
+    return (1.0 - juliaBlend) * noiseBound + juliaBlend * JULIA_FIELD_RANGE * juliaUnit(idx, num_iter);
 }
 
-Real JuliaSet::queryFieldValue(const VEC3F& point, double escapeRadius, size_t idx, size_t num_iter) const {
-    // Perturb the current position by perlin noise. Approximately simulating 
-    // perturbed mesh surface without actually editing the mesh.
-    VEC3F currPos = point + alpha * noise.getFieldValue(point + VEC3F(beta, beta, beta));
-    // Calculate signed distance to mesh
-    return computeSignedDistanceToMesh(currPos, idx, num_iter);
+Real JuliaSet::juliaReach() const {
+    // Capped to the distance inside the escape bound, see juliaDistanceEstimates
+    return juliaScale * juliaEscapeBound(c);
+}
+
+Real JuliaSet::juliaSurfaceMargin(size_t idx, size_t num_iter) const {
+    if (juliaBlend == 0.0) return 0.0;
+    if (juliaBlend >= 1.0) return std::numeric_limits<Real>::infinity();
+
+    // The Julia field peaks at the surface offset, so the blend can only be positive
+    // where the mesh distance is above -blend / (1 - blend) times that, a world
+    // distance the portal transform shrinks by at most its smallest singular value
+    Matrix<Real, 3, 3> linear = pm.getTransform(idx, num_iter).topLeftCorner<3, 3>();
+    JacobiSVD<Matrix<Real, 3, 3>> svd(linear);
+    return juliaBlend / (1.0 - juliaBlend) * JULIA_SURFACE_OFFSET * juliaUnit(idx, num_iter) / svd.singularValues()[2];
 }
 
 // input output vex 
@@ -180,6 +479,12 @@ QUATERNION JuliaSet::applyIteration(const QUATERNION& point) const {
     return result;
 }
 
+void JuliaSet::setJuliaField(double blend, double scale) {
+    juliaBlend = blend;
+    juliaScale = scale;
+    compositeBoxes.clear();
+}
+
 void JuliaSet::setQuaternionC(const QUATERNION& newC) {
     c = newC;
 }
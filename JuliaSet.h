@@ -3,45 +3,135 @@
 #include "Quaternion/SETTINGS.h"
 #include "Quaternion/QUATERNION.h"
 #include <vector>
+#include <map>
+#include <memory>
 
 #include "PortalMap.h"
 #include "VersorMap.h"
+#include "VersorGrid.h"
 #include "mesh.h"
+#include "MeshBVH.h"
+
+// Portal index selecting the composite field: the union of every portal copy set
+// with setCompositeMembers, meshed in one pass. Accepted wherever a portal index is.
+const size_t COMPOSITE_FIELD = (size_t)-1;
 
 class JuliaSet {
 public:
 	JuliaSet(unsigned int maxIter, double maxMag, double alpha_, double beta_, const QUATERNION& c, Versor versor);
 
-	// Returns whether the point is in the Julia set (false)
+	// Signed distance (positive inside) from a world space point to the noise perturbed
+	// copy of the input mesh for portal idx at iteration num_iter. For COMPOSITE_FIELD,
+	// the largest value over the composite members, i.e. their union; once prepared,
+	// members that cannot raise it are skipped.
 	Real queryFieldValue(const VEC3F& point, double escapeRadius = 4.0, size_t idx = 0, size_t num_iter = 1) const;
 
+	// queryFieldValue for count points. Single portal copies transform the points and
+	// evaluate their noise in one batch.
+	void queryFieldValues(const VEC3F* points, Real* values, size_t count, size_t idx = 0, size_t num_iter = 1) const;
+
+	// queryFieldValue and its gradient with respect to point in one query: the
+	// direction away from the closest point, carried back through the portal
+	// transform and the analytic derivative of the noise. Evaluates the noise
+	// exactly even with a baked grid. The gradient points into the surface.
+	Real queryFieldValueAndGradient(const VEC3F& point, VEC3F* gradient, size_t idx = 0, size_t num_iter = 1) const;
+
+	// Largest distance the noise can move a point of the portal copy for idx at
+	// num_iter, so |queryFieldValue(x) - distance to the unperturbed copy| stays below it.
+	// With a Julia blend, the bound on |queryFieldValue(x) - (1 - blend) times that
+	// distance| instead.
+	Real fieldPerturbationBound(size_t idx = 0, size_t num_iter = 1) const;
+
+	// Largest rate at which the field changes with distance before that perturbation:
+	// 1 for the mesh distance, weighted down by the Julia blend
+	Real fieldLipschitzBound() const { return 1.0 - juliaBlend; }
+
+	// Blends the quaternion Julia field into the mesh field, which becomes (1 - blend)
+	// times the mesh distance plus blend times the Julia distance estimate. The Julia
+	// field is taken at the input space point, like the noise, with one Julia unit
+	// spanning scale input units. A blend of 0 leaves the mesh field unchanged.
+	void setJuliaField(double blend, double scale);
+	double getJuliaBlend() const { return juliaBlend; }
+
+	// Radius around the input space origin outside which the Julia field is negative
+	Real juliaReach() const;
+
+	// Farthest the Julia field can carry the surface past the noise perturbed mesh of
+	// portal idx at num_iter, in input units. Infinite at a blend of 1.
+	Real juliaSurfaceMargin(size_t idx, size_t num_iter) const;
+
 	// Iteration func
 	QUATERNION applyIteration(const QUATERNION& point) const;
 
 	void setInputMesh(const Mesh& mesh);
+
+	// Transforms the input mesh into its portal copy for an iteration, builds its BVH
+	// and caches the portal transforms. Must be called before sampling; queries for
+	// unprepared iterations fall back to transforming the untransformed mesh on the fly.
+	// COMPOSITE_FIELD prepares every composite member.
+	void prepareIteration(size_t idx, size_t num_iter);
+	void clearIterations();
+
+	// (portal index, iteration) of the portal copies united by COMPOSITE_FIELD
+	void setCompositeMembers(const std::vector<std::pair<size_t, size_t>>& members) { compositeMembers = members; compositeBoxes.clear(); }
+	const std::vector<std::pair<size_t, size_t>>& getCompositeMembers() const { return compositeMembers; }
+
+	// BVH of a prepared portal copy, null if not prepared. Handing one back through
+	// setIterationBVH skips rebuilding it, e.g. from a FractalCache.
+	std::shared_ptr<const MeshBVH> iterationBVH(size_t idx, size_t num_iter) const;
+	void setIterationBVH(size_t idx, size_t num_iter, std::shared_ptr<const MeshBVH> iterationBvh);
+
 	VEC3F computeClosestPointOnMesh(const VEC3F& point, size_t idx, size_t num_iter) const;
-	bool isPointInsideMesh(const VEC3F& point) const;
 	Real computeSignedDistanceToMesh(const VEC3F& point, size_t idx, size_t num_iter) const;
 
 	void setQuaternionC(const QUATERNION& newC);
 	void setMaxIterations(int maxIter);
 	void setMaxMagnitude(double maxMag);
 
-	void setPortalMap(const PortalMap& map) { pm = map; }
-	const PortalMap& getPortalMap() const { return pm; }
+	// Baked noise to read instead of evaluating the versor, null for exact noise. The
+	// grid covers noise space, i.e. input mesh positions offset by beta.
+	void setNoiseGrid(std::shared_ptr<const VersorGrid> grid) { noiseGrid = grid; }
+	const Versor& getNoise() const { return noise; }
 
-	PortalMap pm;
+	// Replaces the portal transforms and drops the portal copies built from the old ones
+	void setPortalMap(const PortalMap& map) { pm = map; clearIterations(); }
+	const PortalMap& getPortalMap() const { return pm; }
 
 private:
+	bool closestHitOnMesh(const VEC3F& point, size_t idx, size_t num_iter, MeshBVH::ClosestHit* hit) const;
+	Real queryCompositeFieldValue(const VEC3F& point, double escapeRadius) const;
+	Real queryCompositeFieldValueAndGradient(const VEC3F& point, VEC3F* gradient) const;
+	const std::vector<std::pair<Real, size_t>>& compositeOrder(const VEC3F& point) const;
+	VEC3F noiseDirection(const VEC3F& noisePos) const;
+	void juliaFieldValues(const VEC3F* origPts, Real* values, size_t count) const;
+	Real juliaValueAndGradient(const VEC3F& origPt, size_t idx, size_t num_iter, VEC3F* gradient) const;
+	Real juliaUnit(size_t idx, size_t num_iter) const;
+
+	// Bounds of a composite member's field: its portal copy's box and how far the
+	// noise can move it
+	struct CompositeBox {
+		VEC3F boxMin, boxMax;
+		Real perturbation;
+	};
+
 	int maxIterations;
 	double maxMagnitude;
 	QUATERNION c;
 	Versor noise;
+	std::shared_ptr<const VersorGrid> noiseGrid;
 
+	PortalMap pm;
 	Mesh inputMesh;
+	MeshBVH bvh;
+	std::map<std::pair<size_t, size_t>, std::shared_ptr<const MeshBVH>> iterationMeshes;	// keyed on (portal index, iteration)
+	std::vector<std::pair<size_t, size_t>> compositeMembers;
+	std::vector<CompositeBox> compositeBoxes;	// one per member once prepared, else empty
 	bool hasMesh = false;
+	bool inputClosed = false;	// every edge shared by two triangles, see compositeOrder
 
 	double boundary_threshold = 1.0;
 	double scale_factor = 2.0;
 	double alpha, beta;
+	double juliaBlend = 0.0;
+	double juliaScale = 1.0;
 };
\ No newline at end of file
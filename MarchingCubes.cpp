@@ -1,21 +1,18 @@
 #include "MarchingCubes.h"
-#include <maya/MGlobal.h>
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "Quaternion/SETTINGS.h"
+#include "ScalarGrid.h"
 
 typedef struct {
     double x,y,z;
 } XYZ;
  
 typedef struct {
-    XYZ p[8];
     double val[8];
 } GRIDCELL;
- 
-typedef struct {
-    XYZ p[3];         /* Vertices */
-} TRIANGLE;
 
 #define ABS(x) (x < 0 ? -(x) : (x))
 
@@ -369,19 +366,24 @@ static constexpr int triTable[256][16] =
 
 /*-------------------------------------------------------------------------
    Return the point between two points in the same ratio as
-   isolevel is between valp1 and valp2
+   isolevel is between valp1 and valp2. If snapped is given it is set to
+   0 or 1 when the point collapses onto p1 or p2, and -1 otherwise.
 */
-XYZ VertexInterp(double isolevel,XYZ p1,XYZ p2,double valp1,double valp2)
+XYZ VertexInterp(double isolevel,XYZ p1,XYZ p2,double valp1,double valp2,int* snapped = nullptr)
 {
    double mu;
    XYZ p;
 
+   if (snapped) *snapped = 0;
    if (ABS(isolevel-valp1) < 0.00001)
       return(p1);
-   if (ABS(isolevel-valp2) < 0.00001)
+   if (ABS(isolevel-valp2) < 0.00001) {
+      if (snapped) *snapped = 1;
       return(p2);
+   }
    if (ABS(valp1-valp2) < 0.00001)
       return(p1);
+   if (snapped) *snapped = -1;
    mu = (isolevel - valp1) / (valp2 - valp1);
    p.x = p1.x + mu * (p2.x - p1.x);
    p.y = p1.y + mu * (p2.y - p1.y);
@@ -391,101 +393,35 @@ XYZ VertexInterp(double isolevel,XYZ p1,XYZ p2,double valp1,double valp2)
 }
 
 /*-------------------------------------------------------------------------
-   Given a grid cell and an isolevel, calculate the triangular
-   facets requied to represent the isosurface through the cell.
-   Return the number of triangular facets, the array "triangles"
-   will be loaded up with the vertices at most 5 triangular facets.
-   0 will be returned if the grid cell is either totally above
-   of totally below the isolevel.
+   Given the cube index of a grid cell (which vertices are below the
+   isolevel) and the mesh vertex of each intersected edge, write the
+   triangular facets representing the isosurface through the cell into
+   tris, at most 5 facets (15 indices).
+   Return the number of triangular facets, 0 if the grid cell is either
+   totally above of totally below the isolevel.
 */
-std::vector<TRIANGLE> PolygoniseCube(GRIDCELL* g,double iso)
+int PolygoniseCube(int cubeindex,const int edgeVerts[12],uint* tris)
 {
-    std::vector<TRIANGLE> tris;
-
     int i,ntri = 0;
-    int cubeindex = 0;
-    XYZ vertlist[12];
-
-    /*
-        Determine the index into the edge table which
-        tells us which vertices are inside of the surface
-    */
-    if ((*g).val[0] < iso) cubeindex |= 1;
-    if ((*g).val[1] < iso) cubeindex |= 2;
-    if ((*g).val[2] < iso) cubeindex |= 4;
-    if ((*g).val[3] < iso) cubeindex |= 8;
-    if ((*g).val[4] < iso) cubeindex |= 16;
-    if ((*g).val[5] < iso) cubeindex |= 32;
-    if ((*g).val[6] < iso) cubeindex |= 64;
-    if ((*g).val[7] < iso) cubeindex |= 128;
-
-    /* Cube is entirely in/out of the surface */
-    if (edgeTable[cubeindex] == 0)
-        return tris;
-
-    /* Find the vertices where the surface intersects the cube */
-    if (edgeTable[cubeindex] & 1) {
-        vertlist[0] = VertexInterp(iso,(*g).p[0],(*g).p[1],(*g).val[0],(*g).val[1]);
-    }
-    if (edgeTable[cubeindex] & 2) {
-        vertlist[1] = VertexInterp(iso,(*g).p[1],(*g).p[2],(*g).val[1],(*g).val[2]);
-    }
-    if (edgeTable[cubeindex] & 4) {
-        vertlist[2] = VertexInterp(iso,(*g).p[2],(*g).p[3],(*g).val[2],(*g).val[3]);
-    }
-    if (edgeTable[cubeindex] & 8) {
-        vertlist[3] = VertexInterp(iso,(*g).p[3],(*g).p[0],(*g).val[3],(*g).val[0]);
-    }
-    if (edgeTable[cubeindex] & 16) {
-        vertlist[4] = VertexInterp(iso,(*g).p[4],(*g).p[5],(*g).val[4],(*g).val[5]);
-    }
-    if (edgeTable[cubeindex] & 32) {
-        vertlist[5] = VertexInterp(iso,(*g).p[5],(*g).p[6],(*g).val[5],(*g).val[6]);
-    }
-    if (edgeTable[cubeindex] & 64) {
-        vertlist[6] = VertexInterp(iso,(*g).p[6],(*g).p[7],(*g).val[6],(*g).val[7]);
-    }
-    if (edgeTable[cubeindex] & 128) {
-        vertlist[7] = VertexInterp(iso,(*g).p[7],(*g).p[4],(*g).val[7],(*g).val[4]);
-    }
-    if (edgeTable[cubeindex] & 256) {
-        vertlist[8] = VertexInterp(iso,(*g).p[0],(*g).p[4],(*g).val[0],(*g).val[4]);
-    }
-    if (edgeTable[cubeindex] & 512) {
-        vertlist[9] = VertexInterp(iso,(*g).p[1],(*g).p[5],(*g).val[1],(*g).val[5]);
-    }
-    if (edgeTable[cubeindex] & 1024) {
-        vertlist[10] = VertexInterp(iso,(*g).p[2],(*g).p[6],(*g).val[2],(*g).val[6]);
-    }
-    if (edgeTable[cubeindex] & 2048) {
-        vertlist[11] = VertexInterp(iso,(*g).p[3],(*g).p[7],(*g).val[3],(*g).val[7]);
-    }
 
-    /* Create the triangles */
     for (i=0;triTable[cubeindex][i]!=-1;i+=3) {
-        TRIANGLE tri;
-        tri.p[0] = vertlist[triTable[cubeindex][i  ]];
-        tri.p[1] = vertlist[triTable[cubeindex][i+1]];
-        tri.p[2] = vertlist[triTable[cubeindex][i+2]];
-        tris.emplace_back(tri);
+        tris[i  ] = edgeVerts[triTable[cubeindex][i  ]];
+        tris[i+1] = edgeVerts[triTable[cubeindex][i+1]];
+        tris[i+2] = edgeVerts[triTable[cubeindex][i+2]];
+        ntri++;
     }
 
-    return tris;
+    return ntri;
 }
 
-// custom helper functions
-// Hash function for XYZ to avoid duplicate vertices
-struct XYZHash {
-    std::size_t operator()(const XYZ& v) const {
-        return std::hash<float>()(v.x) ^ std::hash<float>()(v.y) ^ std::hash<float>()(v.z);
-    }
+// Cube vertex offsets and edge end points, following the numbering above
+static const int cornerOffset[8][3] = {
+    {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1}
 };
-
-struct XYZEqual {
-    bool operator()(const XYZ& a, const XYZ& b) const {
-        return (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
-    }
+static const int edgeCorners[12][2] = {
+    {0,1}, {1,2}, {3,2}, {0,3}, {4,5}, {5,6}, {7,6}, {4,7}, {0,4}, {1,5}, {2,6}, {3,7}
 };
+static const int edgeAxis[12] = { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 };
 
 // Compute cross product of two vectors
 VEC3F CrossProduct(const VEC3F& a, const VEC3F& b) {
@@ -500,38 +436,95 @@ VEC3F Normalize(const VEC3F& v) {
     return (length > 0) ? VEC3F{v[0] / length, v[1] / length, v[2] / length} : VEC3F{0, 0, 0};
 }
 
-void MarchingCubes(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, bool isLowRes) {
-    int NX = 50;
-    int NY = 50;
-    int NZ = 50;
+size_t GridResolution::numSamples() const {
+    return static_cast<size_t>(nx + 1) * (ny + 1) * (nz + 1);
+}
+
+size_t GridResolution::memoryBytes() const {
+    size_t rowStride = (nx + 1 + ScalarGrid::ROW_ALIGN - 1) / ScalarGrid::ROW_ALIGN * ScalarGrid::ROW_ALIGN;
+    size_t samples = rowStride * (ny + 1) * (nz + 1) * sizeof(Real);
+    size_t edgeCaches = 7 * static_cast<size_t>(nx + 1) * (ny + 1) * sizeof(int);
+    return samples + edgeCaches;
+}
+
+static int clampResolution(Real cells) {
+    if (!(cells > MIN_GRID_RESOLUTION)) return MIN_GRID_RESOLUTION;
+    if (cells > MAX_GRID_RESOLUTION) return MAX_GRID_RESOLUTION;
+    // Extents meant to hold a whole number of voxels come out a rounding error
+    // above it, which must not cost an extra cell
+    return static_cast<int>(std::ceil(cells - 1e-6 * cells));
+}
+
+GridResolution resolutionFromVoxelSize(const VEC3F& minBox, const VEC3F& maxBox, Real voxelSize) {
+    VEC3F extent = maxBox - minBox;
+    GridResolution res;
+    res.nx = clampResolution(extent[0] / voxelSize);
+    res.ny = clampResolution(extent[1] / voxelSize);
+    res.nz = clampResolution(extent[2] / voxelSize);
+    return res;
+}
+
+GridResolution resolutionFromBudget(const VEC3F& minBox, const VEC3F& maxBox, size_t voxelBudget) {
+    // Short axes that would fall under the minimum keep it and hand the rest
+    // of the budget to the other axes
+    VEC3F extent = maxBox - minBox;
+    bool clamped[3] = { !(extent[0] > 0), !(extent[1] > 0), !(extent[2] > 0) };
+    Real voxelSize = 0;
+    for (int pass = 0; pass < 4; ++pass) {
+        Real budget = (Real)std::max<size_t>(voxelBudget, 1);
+        Real freeVolume = 1;
+        int freeAxes = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (clamped[axis]) {
+                budget /= MIN_GRID_RESOLUTION;
+            } else {
+                freeVolume *= extent[axis];
+                freeAxes++;
+            }
+        }
+        if (freeAxes == 0 || !(freeVolume > 0)) break;
+        voxelSize = std::pow(freeVolume / std::max<Real>(budget, 1), 1.0 / freeAxes);
+
+        bool changed = false;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (!clamped[axis] && extent[axis] < MIN_GRID_RESOLUTION * voxelSize) {
+                clamped[axis] = true;
+                changed = true;
+            }
+        }
+        if (!changed) break;
+    }
 
-    if (isLowRes) {
-        NX = 10;
-        NY = 10;
-        NZ = 10;
+    if (!(voxelSize > 0)) {
+        // Degenerate box, only the minimum resolution makes sense
+        GridResolution res;
+        res.nx = res.ny = res.nz = MIN_GRID_RESOLUTION;
+        return res;
     }
+    return resolutionFromVoxelSize(minBox, maxBox, voxelSize);
+}
+
+// Edge length, in cells, of the blocks the narrow band is tested on
+static const int BLOCK_CELLS = 8;
+
+// Vertices per thread pool task when evaluating normals
+static const size_t NORMAL_CHUNK = 256;
+
+void MarchingCubes(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, const GridResolution& resolution, ThreadPool& pool, Profile* profile, JobProgress* progress) {
+    int NX = resolution.nx;
+    int NY = resolution.ny;
+    int NZ = resolution.nz;
 
-    std::vector<std::vector<std::vector<double>>> data;
-    std::vector<TRIANGLE> tris;
+    // Sample grid, kept alive between passes so repeated calls reuse its allocation.
+    // Accessed through a reference so pool workers see the calling thread's grid.
+    static thread_local ScalarGrid sampleGrid;
+    ScalarGrid& data = sampleGrid;
+    data.resize(NX+1, NY+1, NZ+1);
 
 	int i,j,k,l;
     double isolevel = 0.0;
 	GRIDCELL grid;
 
-	data.resize(NX+1);
-	for (i=0;i<=NX;i++) {
-        std::vector<std::vector<double>> tempYZ;
-        tempYZ.resize(NY+1);
-        data[i] = tempYZ;
-    }
-	for (i=0;i<=NX;i++) {
-		for (j=0;j<=NY;j++) {
-            std::vector<double> tempZ;
-            tempZ.resize(NZ+1);
-            data[i][j] = tempZ;
-        }
-    }
-
     // Adjust min and max box sizes to account for full box diff
     float xSpan = maxBox[0] - minBox[0];
     float ySpan = maxBox[1] - minBox[1];
@@ -546,123 +539,234 @@ void MarchingCubes(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t
     ySpan = maxBox[1] - minBox[1];
     zSpan = maxBox[2] - minBox[2];
 
-    // Populate a 3D grid of Julia set field queries
-	for (k=0;k<=NZ;k++) {
-		for (j=0;j<=NY;j++) {
-			for (i=0;i<=NX;i++) {
-                VEC3F point((float)i / (float)NX * xSpan + minBox[0],
-                            (float)j / (float)NY * ySpan + minBox[1],
-                            (float)k / (float)NZ * zSpan + minBox[2]);
+    // Transformed mesh, BVH and portal transforms for this portal iteration, shared
+    // read-only by every query below
+    js.prepareIteration(idx, num_iter);
 
-                // Extract equivalent point in the original mesh
-                VEC3F origPt = js.pm.getInvFieldValue(point, idx, num_iter);
+    auto gridPoint = [&](Real i, Real j, Real k) {
+        return VEC3F((float)i / (float)NX * xSpan + minBox[0],
+                     (float)j / (float)NY * ySpan + minBox[1],
+                     (float)k / (float)NZ * zSpan + minBox[2]);
+    };
 
-                data[i][j][k] = js.queryFieldValue(origPt, idx, num_iter);
-			}
-		}
-	}
+    // Narrow band. The field is the exact distance to the portal copy, scaled by
+    // `lipschitz` and moved by at most `perturbation` by the noise and Julia field, so
+    // |f(x) - f(c)| <= lipschitz * |x - c| + 2 * perturbation.
+    // A block whose centre is farther than that from the surface keeps one sign
+    // throughout and cannot produce triangles, so only its centre is queried.
+    const int BX = (NX + BLOCK_CELLS - 1) / BLOCK_CELLS;
+    const int BY = (NY + BLOCK_CELLS - 1) / BLOCK_CELLS;
+    const int BZ = (NZ + BLOCK_CELLS - 1) / BLOCK_CELLS;
+    const Real perturbation = js.fieldPerturbationBound(idx, num_iter);
+    const Real lipschitz = js.fieldLipschitzBound();
+    // Slack for the float rounding of sample positions
+    const Real slack = 1e-5 * (xSpan + ySpan + zSpan);
+
+    // Per block: 0 while it must be sampled, otherwise a signed lower bound on
+    // the field inside it, used as the value of its skipped samples
+    static thread_local std::vector<Real> blockFill;
+    std::vector<Real>& fill = blockFill;
+    fill.assign(static_cast<size_t>(BX) * BY * BZ, 0.0);
+
+    ScopedTimer bandTimer(profile, "band");
+    pool.parallelFor(0, BZ, [&](size_t bz) {
+        int k0 = (int)bz * BLOCK_CELLS, k1 = std::min(k0 + BLOCK_CELLS, NZ);
+        for (int by = 0; by < BY; by++) {
+            int j0 = by * BLOCK_CELLS, j1 = std::min(j0 + BLOCK_CELLS, NY);
+            for (int bx = 0; bx < BX; bx++) {
+                int i0 = bx * BLOCK_CELLS, i1 = std::min(i0 + BLOCK_CELLS, NX);
+
+                VEC3F lo = gridPoint(i0, j0, k0);
+                VEC3F hi = gridPoint(i1, j1, k1);
+                Real value = js.queryFieldValue((lo + hi) * 0.5, 4.0, idx, num_iter);
+                Real bound = std::abs(value) - lipschitz * 0.5 * (hi - lo).norm() - 2.0 * perturbation - slack;
+                if (bound > 0) {
+                    fill[bx + BX * (by + BY * bz)] = value > 0 ? bound : -bound;
+                }
+            }
+        }
+    });
+    bandTimer.stop();
 
-    // Perform marching cube for each voxel cube
-    for (i=0;i<NX-1;i++) {
-		for (j=0;j<NY-1;j++) {
-			for (k=0;k<NZ-1;k++) {
-                grid.p[0].x = i;
-                grid.p[0].y = j;
-                grid.p[0].z = k;
-                grid.val[0] = data[i][j][k];
-                grid.p[1].x = i+1;
-                grid.p[1].y = j;
-                grid.p[1].z = k; 
-                grid.val[1] = data[i+1][j][k];
-                grid.p[2].x = i+1;
-                grid.p[2].y = j+1;
-                grid.p[2].z = k;
-                grid.val[2] = data[i+1][j+1][k];
-                grid.p[3].x = i;
-                grid.p[3].y = j+1;
-                grid.p[3].z = k;
-                grid.val[3] = data[i][j+1][k];
-                grid.p[4].x = i;
-                grid.p[4].y = j;
-                grid.p[4].z = k+1;
-                grid.val[4] = data[i][j][k+1];
-                grid.p[5].x = i+1;
-                grid.p[5].y = j;
-                grid.p[5].z = k+1;
-                grid.val[5] = data[i+1][j][k+1];
-                grid.p[6].x = i+1;
-                grid.p[6].y = j+1;
-                grid.p[6].z = k+1;
-                grid.val[6] = data[i+1][j+1][k+1];
-                grid.p[7].x = i;
-                grid.p[7].y = j+1;
-                grid.p[7].z = k+1;
-				grid.val[7] = data[i][j+1][k+1];
-                
-				std::vector<TRIANGLE> triangles = PolygoniseCube(&grid,isolevel);
-                size_t n = triangles.size();
-				for (l=0;l<n;l++)
-					tris.emplace_back(triangles[l]);
+    // Blocks sharing sample s along one axis: [lo, hi]
+    auto blockRange = [](int s, int numBlocks, int* lo, int* hi) {
+        *lo = s > 0 ? (s - 1) / BLOCK_CELLS : 0;
+        *hi = std::min(s / BLOCK_CELLS, numBlocks - 1);
+    };
+
+    // A sample can be skipped only if every block sharing it was skipped
+    auto skippedValue = [&](int i, int j, int k, Real* value) {
+        int bxLo, bxHi, byLo, byHi, bzLo, bzHi;
+        blockRange(i, BX, &bxLo, &bxHi);
+        blockRange(j, BY, &byLo, &byHi);
+        blockRange(k, BZ, &bzLo, &bzHi);
+        for (int bz = bzLo; bz <= bzHi; bz++) {
+            for (int by = byLo; by <= byHi; by++) {
+                for (int bx = bxLo; bx <= bxHi; bx++) {
+                    *value = fill[bx + BX * (by + BY * bz)];
+                    if (*value == 0.0) return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // Populate the grid of Julia set field queries in the narrow band. Every sample
+    // is independent, so Z-slabs are spread over the thread pool; results match
+    // the serial order.
+    ScopedTimer samplingTimer(profile, "sampling");
+    if (progress) progress->setSteps(NZ + 1);
+    pool.parallelFor(0, NZ + 1, [&](size_t k) {
+        if (progress && progress->cancelled()) return;
+        Real* slab = data.slice((int)k);
+        // The samples of a row that need the field go to the Julia set as one batch
+        static thread_local std::vector<VEC3F> rowPoints;
+        static thread_local std::vector<Real> rowValues;
+        static thread_local std::vector<int> rowColumns;
+		for (int j=0;j<=NY;j++) {
+            Real* row = slab + j * data.strideY();
+            rowPoints.clear();
+            rowColumns.clear();
+			for (int i=0;i<=NX;i++) {
+                if (!skippedValue(i, j, (int)k, &row[i])) {
+                    rowPoints.push_back(gridPoint(i, j, (int)k));
+                    rowColumns.push_back(i);
+                }
 			}
+            rowValues.resize(rowPoints.size());
+            js.queryFieldValues(rowPoints.data(), rowValues.data(), rowPoints.size(), idx, num_iter);
+            for (size_t s = 0; s < rowColumns.size(); s++) {
+                row[rowColumns[s]] = rowValues[s];
+            }
 		}
-	}
+        if (progress) progress->step();
+    });
+    samplingTimer.stop();
 
-    // Clear old mesh data just in case
+    // Clear old mesh data just in case, keeping the allocations
     mesh.vertices.clear();
     mesh.indices.clear();
     mesh.normals.clear();
+    if (progress && progress->cancelled()) return;
 
-    // Convert the generated list of triangles to new custom mesh representation
-    std::unordered_map<XYZ, unsigned int, XYZHash, XYZEqual> vertexMap;
-    mesh.normals.resize(tris.size() * 3, {0, 0, 0});
-
-    auto rescaleGrid = [&minBox, &maxBox, &NX, &NY, &NZ](VEC3F v) {
+    auto rescaleGrid = [&minBox, &maxBox, &NX, &NY, &NZ](const XYZ& v) {
         // Use NX-1 because marching loop goes from 0 to NX-1
         float invNXm1 = 1.0f / (float)(NX);
         float invNYm1 = 1.0f / (float)(NY);
         float invNZm1 = 1.0f / (float)(NZ);
 
         return VEC3F(
-            v[0] * invNXm1 * (maxBox[0] - minBox[0]) + minBox[0],
-            v[1] * invNYm1 * (maxBox[1] - minBox[1]) + minBox[1],
-            v[2] * invNZm1 * (maxBox[2] - minBox[2]) + minBox[2]
+            v.x * invNXm1 * (maxBox[0] - minBox[0]) + minBox[0],
+            v.y * invNYm1 * (maxBox[1] - minBox[1]) + minBox[1],
+            v.z * invNZm1 * (maxBox[2] - minBox[2]) + minBox[2]
         );
     };
-    
-    for (const auto& tri : tris) {
-        VEC3F v0 = rescaleGrid({tri.p[0].x, tri.p[0].y, tri.p[0].z});
-        VEC3F v1 = rescaleGrid({tri.p[1].x, tri.p[1].y, tri.p[1].z});
-        VEC3F v2 = rescaleGrid({tri.p[2].x, tri.p[2].y, tri.p[2].z});
-        VEC3F tripi[3] = { v0, v1, v2 };
-
-        // Compute face normal
-        VEC3F edge1 = {v1[0] - v0[0], v1[1] - v0[1], v1[2] - v0[2]};
-        VEC3F edge2 = {v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]};
-        VEC3F normal = Normalize(CrossProduct(edge1, edge2));
-
-        for (i = 0; i < 3; ++i) {
-            const XYZ& vertex = { tripi[i][0], tripi[i][1], tripi[i][2] };
-            
-            // If vertex is new, add it to the mesh
-            if (vertexMap.find(vertex) == vertexMap.end()) {
-                vertexMap[vertex] = static_cast<unsigned int>(mesh.vertices.size());
-                mesh.vertices.push_back({vertex.x, vertex.y, vertex.z});
-                mesh.normals.push_back(normal);
-            } else {
-                // Accumulate normals for smoothing
-                unsigned int index = vertexMap[vertex];
-                mesh.normals[index][0] += normal[0];
-                mesh.normals[index][1] += normal[1];
-                mesh.normals[index][2] += normal[2];
-            }
-            
-            // Store the index of the vertex in the mesh
-            mesh.indices.push_back(vertexMap[vertex]);
-        }
-    }
 
-    // Normalize all vertex normals
-    for (auto& normal : mesh.normals) {
-        normal = Normalize(normal);
+    auto addVertex = [&mesh, &rescaleGrid](const XYZ& p) {
+        mesh.vertices.push_back(rescaleGrid(p));
+        mesh.normals.push_back(VEC3F(0, 0, 0));
+        return static_cast<int>(mesh.vertices.size() - 1);
+    };
+
+    // Mesh vertex of every edge crossing in the current slice pair, keyed by the
+    // integer (i, j) of the edge's lower end in its plane. [0] is the bottom plane
+    // of the slab, [1] the top one; z edges run between the two. Crossings that
+    // snap onto a grid corner are shared through the corner tables instead.
+    const int planeSize = (NX+1) * (NY+1);
+    static thread_local std::vector<int> xEdges[2], yEdges[2], zEdges, corners[2];
+    for (int plane = 0; plane < 2; ++plane) {
+        xEdges[plane].assign(planeSize, -1);
+        yEdges[plane].assign(planeSize, -1);
+        corners[plane].assign(planeSize, -1);
     }
+    zEdges.assign(planeSize, -1);
+
+    auto edgeVertex = [&](int e, int ci, int cj, int ck) {
+        // Interpolate from the lower end so both cells sharing the edge agree
+        int c0 = edgeCorners[e][0];
+        int c1 = edgeCorners[e][1];
+        int ei = ci + cornerOffset[c0][0];
+        int ej = cj + cornerOffset[c0][1];
+        int plane = cornerOffset[c0][2];
+        int key = ei + ej * (NX+1);
+
+        int& slot = edgeAxis[e] == 0 ? xEdges[plane][key] : (edgeAxis[e] == 1 ? yEdges[plane][key] : zEdges[key]);
+        if (slot >= 0) return slot;
+
+        XYZ p1 = { (double)ei, (double)ej, (double)(ck + plane) };
+        XYZ p2 = { (double)(ci + cornerOffset[c1][0]), (double)(cj + cornerOffset[c1][1]), (double)(ck + cornerOffset[c1][2]) };
+        int snapped;
+        XYZ p = VertexInterp(isolevel, p1, p2, grid.val[c0], grid.val[c1], &snapped);
+
+        if (snapped >= 0) {
+            int c = snapped == 0 ? c0 : c1;
+            int& cornerSlot = corners[cornerOffset[c][2]][(ci + cornerOffset[c][0]) + (cj + cornerOffset[c][1]) * (NX+1)];
+            if (cornerSlot < 0) cornerSlot = addVertex(p);
+            slot = cornerSlot;
+        } else {
+            slot = addVertex(p);
+        }
+        return slot;
+    };
+
+    // Perform marching cube for each voxel cube, one slab of the grid at a time
+    ScopedTimer polygoniseTimer(profile, "polygonise");
+    size_t activeCells = 0;
+    int edgeVerts[12];
+    uint cellTris[15];
+    for (k=0;k<NZ-1;k++) {
+        if (k > 0) {
+            // The top plane of the previous slab becomes the bottom one
+            std::swap(xEdges[0], xEdges[1]);
+            std::swap(yEdges[0], yEdges[1]);
+            std::swap(corners[0], corners[1]);
+            std::fill(xEdges[1].begin(), xEdges[1].end(), -1);
+            std::fill(yEdges[1].begin(), yEdges[1].end(), -1);
+            std::fill(corners[1].begin(), corners[1].end(), -1);
+            std::fill(zEdges.begin(), zEdges.end(), -1);
+        }
+
+		for (j=0;j<NY-1;j++) {
+			for (i=0;i<NX-1;i++) {
+                /*
+                    Determine the index into the edge table which
+                    tells us which vertices are inside of the surface
+                */
+                int cubeindex = 0;
+                for (l=0;l<8;l++) {
+                    grid.val[l] = data.at(i+cornerOffset[l][0],j+cornerOffset[l][1],k+cornerOffset[l][2]);
+                    if (grid.val[l] < isolevel) cubeindex |= 1 << l;
+                }
+
+                /* Cube is entirely in/out of the surface */
+                if (edgeTable[cubeindex] == 0)
+                    continue;
+
+                /* Find the vertices where the surface intersects the cube */
+                for (int e=0;e<12;e++) {
+                    if (edgeTable[cubeindex] & (1 << e))
+                        edgeVerts[e] = edgeVertex(e, i, j, k);
+                }
+
+                int ntri = PolygoniseCube(cubeindex, edgeVerts, cellTris);
+                if (ntri > 0) activeCells++;
+                mesh.indices.insert(mesh.indices.end(), cellTris, cellTris + 3 * ntri);
+			}
+		}
+	}
+    profileCount(PROFILE_ACTIVE_CELLS, activeCells);
+    polygoniseTimer.stop();
+
+    // Smooth normals from the field gradient at every vertex, one query each. The
+    // field is positive inside, so the outward normal is against the gradient.
+    ScopedTimer normalsTimer(profile, "normals");
+    const size_t numVertices = mesh.vertices.size();
+    pool.parallelFor(0, (numVertices + NORMAL_CHUNK - 1) / NORMAL_CHUNK, [&](size_t chunk) {
+        size_t end = std::min(numVertices, (chunk + 1) * NORMAL_CHUNK);
+        for (size_t v = chunk * NORMAL_CHUNK; v < end; ++v) {
+            VEC3F gradient;
+            js.queryFieldValueAndGradient(mesh.vertices[v], &gradient, idx, num_iter);
+            mesh.normals[v] = Normalize(-gradient);
+        }
+    });
 }
@@ -4,7 +4,37 @@
 
 #pragma once
 
+#include "JobProgress.h"
 #include "JuliaSet.h"
 #include "mesh.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
 
-void MarchingCubes(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, bool isLowRes);
\ No newline at end of file
+// Number of cells along each axis of the marching cubes grid
+struct GridResolution {
+    int nx = 50;
+    int ny = 50;
+    int nz = 50;
+
+    size_t numSamples() const;
+
+    // Sample grid plus the per-slice edge caches used while polygonising
+    size_t memoryBytes() const;
+};
+
+// Resolution limits per axis
+const int MIN_GRID_RESOLUTION = 4;
+const int MAX_GRID_RESOLUTION = 1024;
+
+// Cubic voxels of side voxelSize over the box
+GridResolution resolutionFromVoxelSize(const VEC3F& minBox, const VEC3F& maxBox, Real voxelSize);
+
+// Cubic voxels sized so the grid holds about voxelBudget cells, split between the
+// axes in proportion to the box extents
+GridResolution resolutionFromBudget(const VEC3F& minBox, const VEC3F& maxBox, size_t voxelBudget);
+
+// Stages "band", "sampling", "polygonise" and "normals" are timed into profile if given.
+// Vertex normals are the field gradient, queried once per vertex.
+// progress, if given, advances per sampled slab; once it is cancelled the remaining
+// slabs are skipped and mesh is left empty.
+void MarchingCubes(Mesh& mesh, JuliaSet& js, VEC3F minBox, VEC3F maxBox, size_t idx, size_t num_iter, const GridResolution& resolution, ThreadPool& pool, Profile* profile = nullptr, JobProgress* progress = nullptr);
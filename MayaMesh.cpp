@@ -0,0 +1,200 @@
+#include "MayaMesh.h"
+
+#include <maya/MPointArray.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MGlobal.h>
+#include <maya/MIntArray.h>
+#include <maya/MStatus.h>
+#include <maya/MTypes.h>
+
+#include <maya/MFnDagNode.h>
+#include <maya/MDagPath.h>
+#include <maya/MDagPathArray.h>
+#include <maya/MDGModifier.h>
+#include <maya/MFnTransform.h>
+#include <maya/MTransformationMatrix.h>
+#include <maya/MMatrix.h>
+
+#include <numeric>
+#include <vector>
+
+void meshFromMaya(const MFnMesh& mayaMesh, Mesh* mesh, MObject* material) {
+    // grab the shape’s DAG path, pop off the shape to get the transform
+    MDagPath shapePath;
+    {
+        MFnDagNode fnDag(mayaMesh.object());
+        fnDag.getPath(shapePath);
+    }
+    shapePath.pop();
+    MFnTransform fnXform(shapePath);
+    MTransformationMatrix txMat(fnXform.transformationMatrix());
+    MVector translation = txMat.getTranslation(MSpace::kWorld);
+
+    // Retrieve vertices from the Maya mesh in one block
+    MPointArray points_;
+    mayaMesh.getPoints(points_, MSpace::kWorld);
+    const unsigned int numPoints = points_.length();
+    std::vector<double> pointData(4 * static_cast<size_t>(numPoints));
+    if (numPoints > 0) points_.get(reinterpret_cast<double(*)[4]>(pointData.data()));
+
+    std::vector<VEC3F>& vertices = mesh->vertices;
+    vertices.resize(numPoints);
+    for (unsigned int i = 0; i < numPoints; ++i) {
+        const double* p = &pointData[4 * static_cast<size_t>(i)];
+        vertices[i] = VEC3F(p[0] - translation.x, p[1] - translation.y, p[2] - translation.z);
+    }
+    mesh->computeBounds();
+
+    // UVs are transferred by nearest vertex in the space the fractal is generated in
+    mesh->originalVertices = vertices;
+
+    // Retrieve normals from the Maya mesh
+    MFloatVectorArray normals_;
+    mayaMesh.getNormals(normals_, MSpace::kObject);
+    const unsigned int numNormals = normals_.length();
+    std::vector<float> normalData(3 * static_cast<size_t>(numNormals));
+    if (numNormals > 0) normals_.get(reinterpret_cast<float(*)[3]>(normalData.data()));
+
+    std::vector<VEC3F>& normals = mesh->normals;
+    normals.resize(numNormals);
+    for (unsigned int i = 0; i < numNormals; ++i) {
+        const float* n = &normalData[3 * static_cast<size_t>(i)];
+        normals[i] = VEC3F(n[0], n[1], n[2]);
+    }
+
+    // Retrieve material assignment
+    MObjectArray shaders;
+    MIntArray indices_;
+    mayaMesh.getConnectedShaders(0, shaders, indices_);
+    *material = shaders.length() > 0 ? shaders[0] : MObject::kNullObj;
+
+    // Fan triangulate every polygon straight from the flat count and connectivity arrays
+    MIntArray polygonCounts, polygonConnects;
+    mayaMesh.getVertices(polygonCounts, polygonConnects);
+    std::vector<int> counts(polygonCounts.length()), connects(polygonConnects.length());
+    if (!counts.empty()) polygonCounts.get(counts.data());
+    if (!connects.empty()) polygonConnects.get(connects.data());
+
+    size_t numTriangles = 0;
+    for (int count : counts) {
+        if (count >= 3) numTriangles += count - 2;
+    }
+    std::vector<uint>& indices = mesh->indices;
+    indices.resize(3 * numTriangles);
+    size_t corner = 0, tri = 0;
+    for (int count : counts) {
+        for (int i = 1; i < count - 1; ++i) {
+            indices[tri++] = static_cast<uint>(connects[corner]);
+            indices[tri++] = static_cast<uint>(connects[corner + i]);
+            indices[tri++] = static_cast<uint>(connects[corner + i + 1]);
+        }
+        corner += count;
+    }
+
+    // current UV set name
+    MString uvSetName;
+    mayaMesh.getCurrentUVSetName(uvSetName);
+    mesh->uvSetName = uvSetName.asChar();
+
+    // raw UV coordinate arrays
+    MFloatArray uArray, vArray;
+    mayaMesh.getUVs(uArray, vArray, &uvSetName);
+    mesh->uvU.resize(uArray.length());
+    mesh->uvV.resize(vArray.length());
+    if (!mesh->uvU.empty()) uArray.get(mesh->uvU.data());
+    if (!mesh->uvV.empty()) vArray.get(mesh->uvV.data());
+
+    // face‑vertex UV assignment (counts + indices)
+    MIntArray uvCountsArr, uvIdsArr;
+    mayaMesh.getAssignedUVs(uvCountsArr, uvIdsArr, &uvSetName);
+    mesh->uvCountsVec.resize(uvCountsArr.length());
+    mesh->uvIdsVec.resize(uvIdsArr.length());
+    if (!mesh->uvCountsVec.empty()) uvCountsArr.get(mesh->uvCountsVec.data());
+    if (!mesh->uvIdsVec.empty()) uvIdsArr.get(mesh->uvIdsVec.data());
+}
+
+MObject meshToMaya(const Mesh& mesh, const MObject& material, Profile* profile, ThreadPool* pool) {
+    static_assert(sizeof(uint) == sizeof(int), "triangle indices are handed to Maya as ints");
+    static_assert(sizeof(VEC3F) == 3 * sizeof(Real), "normals are handed to Maya as packed Reals");
+
+    MStatus status;
+    ScopedTimer meshTimer(profile, "maya_mesh");
+
+    // Points are homogeneous in Maya, so they take one packed copy
+    const std::vector<VEC3F>& vertices = mesh.vertices;
+    const std::vector<uint>& indices = mesh.indices;
+    const unsigned int numVertices = static_cast<unsigned int>(vertices.size());
+    std::vector<double> pointData(4 * vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        pointData[4 * i] = vertices[i][0];
+        pointData[4 * i + 1] = vertices[i][1];
+        pointData[4 * i + 2] = vertices[i][2];
+        pointData[4 * i + 3] = 1.0;
+    }
+    MPointArray points(reinterpret_cast<const double(*)[4]>(pointData.data()), numVertices);
+
+    // Triangles only, so the index buffer is the connectivity array as is. Both
+    // arrays are reused for the UV assignment below.
+    const unsigned int numFaces = static_cast<unsigned int>(indices.size()) / 3;
+    MIntArray faceCounts(numFaces, 3);
+    MIntArray faceConnects(reinterpret_cast<const int*>(indices.data()), 3 * numFaces);
+
+    // Create a new Maya mesh using the points, face counts, and connectivity arrays
+    MFnMesh fnMesh;
+    MObject meshObj = fnMesh.create(
+        numVertices, numFaces, points, faceCounts, faceConnects, MObject::kNullObj, &status
+    );
+    if (status != MS::kSuccess) {
+        return MObject::kNullObj;
+    }
+    meshTimer.stop();
+    
+    // ——— 1) Nearest original vertex UVs ———
+    ScopedTimer uvTransferTimer(profile, "uv_transfer");
+    std::vector<float> vertexU, vertexV;
+    mesh.transferUVs(&vertexU, &vertexV, pool);
+    uvTransferTimer.stop();
+
+    ScopedTimer uvTimer(profile, "maya_uvs");
+    if (!vertexU.empty()) {
+        MFloatArray newU(vertexU.data(), static_cast<unsigned int>(vertexU.size()));
+        MFloatArray newV(vertexV.data(), static_cast<unsigned int>(vertexV.size()));
+
+        // ——— 2) Create UV set on the new mesh ———
+        MString setName = mesh.uvSetName.empty() ? MString("map1") : MString(mesh.uvSetName.c_str());
+        status = fnMesh.createUVSet(setName);
+
+        // ——— 3) Push UV coords into Maya ———
+        status = fnMesh.setUVs(newU, newV, &setName);
+
+        // ——— 4) Assign those UVs per face‑vertex ———
+        // one UV per vertex, so the geometry's own counts and connectivity apply
+        status = fnMesh.assignUVs(faceCounts, faceConnects, &setName);
+
+        // ——— 5) Make it current ———
+        fnMesh.setCurrentUVSetName(setName);
+    }
+
+    uvTimer.stop();
+
+    // Set the vertex normals if the mesh has one normal per vertex
+    ScopedTimer normalsTimer(profile, "maya_normals");
+    const std::vector<VEC3F>& normals = mesh.normals;
+    if (normals.size() == vertices.size() && !normals.empty()) {
+        MVectorArray mNormals(reinterpret_cast<const Real(*)[3]>(normals.data()), numVertices);
+        std::vector<int> vertexIds(vertices.size());
+        std::iota(vertexIds.begin(), vertexIds.end(), 0);
+        MIntArray vertexIndices(vertexIds.data(), numVertices);
+        fnMesh.setVertexNormals(mNormals, vertexIndices);
+    }
+
+    // Assign material back
+    if (!material.isNull()) {
+        MString shadingGroup;
+        MFnDependencyNode depNode(material);
+        shadingGroup = depNode.name();
+        MGlobal::executeCommand("sets -e -forceElement " + shadingGroup + " " + fnMesh.name());
+    }
+
+    return meshObj;
+}
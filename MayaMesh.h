@@ -0,0 +1,20 @@
+#pragma once
+
+#include <maya/MFnMesh.h>
+#include <maya/MObject.h>
+
+#include "mesh.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Conversion between Maya meshes and the Maya-free Mesh used by the fractal core
+
+// Reads vertices (relative to the mesh transform), normals, fan triangulated faces and
+// the current UV set. The first connected shader is returned through material.
+void meshFromMaya(const MFnMesh& mayaMesh, Mesh* mesh, MObject* material);
+
+// Creates a new Maya mesh, with UVs transferred from the original vertices and the
+// given material assigned if it is not null. The UV lookups are spread over pool if
+// given. Stages "maya_mesh", "uv_transfer", "maya_uvs" and "maya_normals" are timed
+// into profile if given.
+MObject meshToMaya(const Mesh& mesh, const MObject& material, Profile* profile = nullptr, ThreadPool* pool = nullptr);
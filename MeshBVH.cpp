@@ -0,0 +1,411 @@
+#include "MeshBVH.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "Profiler.h"
+
+#define BVH_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 48
+#define BVH_NUM_BINS 12
+
+// Relative slack on the batched squared distances, which are computed differently
+// from closestPointOnTriangle and must never rule out the triangle it picks
+#define BATCH_DISTANCE_SLACK 1e-6
+// Rounding allowance on top, relative to the squared reach of the leaf (its size
+// plus the distance so far). Tiny in double, it is what keeps float builds exact.
+#define BATCH_DISTANCE_ROUNDING (1e4 * std::numeric_limits<Real>::epsilon())
+
+VEC3F closestPointOnTriangle(const VEC3F& p, const VEC3F& a, const VEC3F& b, const VEC3F& c, TriangleFeature* feature) {
+    // Compute edges
+    VEC3F ab = b - a;
+    VEC3F ac = c - a;
+    VEC3F ap = p - a;
+
+    // Compute dot products
+    Real d1 = ab.dot(ap);
+    Real d2 = ac.dot(ap);
+
+    // Check if P in vertex region outside A
+    if (d1 <= 0 && d2 <= 0) {
+        if (feature) *feature = TRI_VERTEX_A;
+        return a;
+    }
+
+    // Check if P in vertex region outside B
+    VEC3F bp = p - b;
+    Real d3 = ab.dot(bp);
+    Real d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) {
+        if (feature) *feature = TRI_VERTEX_B;
+        return b;
+    }
+
+    // Check if P in edge region of AB
+    Real vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        Real v = d1 / (d1 - d3);
+        if (feature) *feature = TRI_EDGE_AB;
+        return a + ab * v;
+    }
+
+    // Check if P in vertex region outside C
+    VEC3F cp = p - c;
+    Real d5 = ab.dot(cp);
+    Real d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) {
+        if (feature) *feature = TRI_VERTEX_C;
+        return c;
+    }
+
+    // Check if P in edge region of AC
+    Real vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        Real w = d2 / (d2 - d6);
+        if (feature) *feature = TRI_EDGE_CA;
+        return a + ac * w;
+    }
+
+    // Check if P in edge region of BC
+    Real va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        Real w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        if (feature) *feature = TRI_EDGE_BC;
+        return b + (c - b) * w;
+    }
+
+    // P inside face region. Compute barycentric coordinates (u, v, w)
+    Real denom = 1.0 / (va + vb + vc);
+    Real v = vb * denom;
+    Real w = vc * denom;
+    if (feature) *feature = TRI_FACE;
+    return a + ab * v + ac * w;
+}
+
+static Real boxArea(const VEC3F& boxMin, const VEC3F& boxMax) {
+    VEC3F d = boxMax - boxMin;
+    return 2.0 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+// Squared distance from p to the axis aligned box, zero if p is inside
+static Real boxDistance2(const VEC3F& p, const VEC3F& boxMin, const VEC3F& boxMax) {
+    Real d2 = 0.0;
+    for (int axis = 0; axis < 3; ++axis) {
+        Real d = std::max(std::max(boxMin[axis] - p[axis], p[axis] - boxMax[axis]), Real(0.0));
+        d2 += d * d;
+    }
+    return d2;
+}
+
+void MeshBVH::clear() {
+    nodes.clear();
+    triOrder.clear();
+    verts.clear();
+    tris.clear();
+    leafTriangles.clear();
+    faceNormals.clear();
+    edgeNormals.clear();
+    vertexNormals.clear();
+}
+
+void MeshBVH::build(const std::vector<VEC3F>& vertices, const std::vector<uint>& indices) {
+    clear();
+
+    verts = vertices;
+    tris = indices;
+
+    uint numTris = static_cast<uint>(tris.size() / 3);
+    if (numTris == 0) return;
+
+    std::vector<VEC3F> centroids(numTris);
+    triOrder.resize(numTris);
+    for (uint t = 0; t < numTris; ++t) {
+        centroids[t] = (verts[tris[3 * t]] + verts[tris[3 * t + 1]] + verts[tris[3 * t + 2]]) / 3.0;
+        triOrder[t] = t;
+    }
+
+    nodes.reserve(2 * numTris);
+    buildNode(centroids, 0, numTris, 0);
+    leafTriangles.build(verts, tris, triOrder);
+
+    computePseudoNormals();
+}
+
+void MeshBVH::computePseudoNormals() {
+    size_t numTris = tris.size() / 3;
+    faceNormals.assign(numTris, VEC3F::Zero());
+    edgeNormals.assign(3 * numTris, VEC3F::Zero());
+    vertexNormals.assign(verts.size(), VEC3F::Zero());
+
+    // Edges are shared through their sorted vertex pair
+    std::unordered_map<unsigned long long, VEC3F> edgeSums;
+    edgeSums.reserve(3 * numTris);
+    auto edgeKey = [](uint a, uint b) {
+        if (a > b) std::swap(a, b);
+        return (static_cast<unsigned long long>(a) << 32) | b;
+    };
+
+    for (size_t t = 0; t < numTris; ++t) {
+        uint ids[3] = { tris[3 * t], tris[3 * t + 1], tris[3 * t + 2] };
+        VEC3F n = (verts[ids[1]] - verts[ids[0]]).cross(verts[ids[2]] - verts[ids[0]]);
+        Real len = n.norm();
+        if (len > 0.0) n /= len;
+        faceNormals[t] = n;
+
+        for (int k = 0; k < 3; ++k) {
+            // Incident angle of the face at vertex k
+            VEC3F e1 = verts[ids[(k + 1) % 3]] - verts[ids[k]];
+            VEC3F e2 = verts[ids[(k + 2) % 3]] - verts[ids[k]];
+            Real denom = e1.norm() * e2.norm();
+            if (denom > 0.0) {
+                Real cosAngle = std::max(Real(-1.0), std::min(Real(1.0), e1.dot(e2) / denom));
+                vertexNormals[ids[k]] += std::acos(cosAngle) * n;
+            }
+
+            auto result = edgeSums.emplace(edgeKey(ids[k], ids[(k + 1) % 3]), n);
+            if (!result.second) result.first->second += n;
+        }
+    }
+
+    for (size_t t = 0; t < numTris; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            edgeNormals[3 * t + k] = edgeSums[edgeKey(tris[3 * t + k], tris[3 * t + (k + 1) % 3])];
+        }
+    }
+}
+
+const VEC3F& MeshBVH::featureNormal(uint triangle, TriangleFeature feature) const {
+    switch (feature) {
+    case TRI_VERTEX_A: return vertexNormals[tris[3 * triangle]];
+    case TRI_VERTEX_B: return vertexNormals[tris[3 * triangle + 1]];
+    case TRI_VERTEX_C: return vertexNormals[tris[3 * triangle + 2]];
+    case TRI_EDGE_AB:  return edgeNormals[3 * triangle];
+    case TRI_EDGE_BC:  return edgeNormals[3 * triangle + 1];
+    case TRI_EDGE_CA:  return edgeNormals[3 * triangle + 2];
+    default:           return faceNormals[triangle];
+    }
+}
+
+Real MeshBVH::signedDistance(const VEC3F& p, const ClosestHit& hit) {
+    bool isInside = (p - hit.point).dot(hit.normal) < 0.0;
+    return isInside ? hit.distance : -hit.distance;
+}
+
+uint MeshBVH::buildNode(std::vector<VEC3F>& centroids, uint start, uint count, int depth) {
+    uint nodeIdx = static_cast<uint>(nodes.size());
+    nodes.emplace_back();
+
+    // Bounds of the triangles and of their centroids
+    const Real inf = std::numeric_limits<Real>::max();
+    VEC3F boxMin(inf, inf, inf), boxMax(-inf, -inf, -inf);
+    VEC3F cenMin(inf, inf, inf), cenMax(-inf, -inf, -inf);
+    for (uint i = start; i < start + count; ++i) {
+        uint t = triOrder[i];
+        for (int k = 0; k < 3; ++k) {
+            const VEC3F& v = verts[tris[3 * t + k]];
+            boxMin = boxMin.cwiseMin(v);
+            boxMax = boxMax.cwiseMax(v);
+        }
+        cenMin = cenMin.cwiseMin(centroids[t]);
+        cenMax = cenMax.cwiseMax(centroids[t]);
+    }
+    nodes[nodeIdx].boxMin = boxMin;
+    nodes[nodeIdx].boxMax = boxMax;
+    nodes[nodeIdx].start = start;
+    nodes[nodeIdx].count = count;
+
+    int axis;
+    VEC3F cenExtent = cenMax - cenMin;
+    Real extent = cenExtent.maxCoeff(&axis);
+    if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH || extent <= 0.0) {
+        return nodeIdx;
+    }
+
+    // Binned surface area heuristic along the longest centroid axis
+    struct Bin {
+        VEC3F boxMin, boxMax;
+        uint count = 0;
+    } bins[BVH_NUM_BINS];
+    for (Bin& bin : bins) {
+        bin.boxMin = VEC3F(inf, inf, inf);
+        bin.boxMax = VEC3F(-inf, -inf, -inf);
+    }
+
+    auto binOf = [&](uint t) {
+        int b = static_cast<int>(BVH_NUM_BINS * (centroids[t][axis] - cenMin[axis]) / extent);
+        return std::min(b, BVH_NUM_BINS - 1);
+    };
+
+    for (uint i = start; i < start + count; ++i) {
+        uint t = triOrder[i];
+        Bin& bin = bins[binOf(t)];
+        for (int k = 0; k < 3; ++k) {
+            const VEC3F& v = verts[tris[3 * t + k]];
+            bin.boxMin = bin.boxMin.cwiseMin(v);
+            bin.boxMax = bin.boxMax.cwiseMax(v);
+        }
+        bin.count++;
+    }
+
+    Real bestCost = inf;
+    int bestSplit = -1;
+    for (int split = 1; split < BVH_NUM_BINS; ++split) {
+        VEC3F lMin(inf, inf, inf), lMax(-inf, -inf, -inf), rMin(inf, inf, inf), rMax(-inf, -inf, -inf);
+        uint lCount = 0, rCount = 0;
+        for (int b = 0; b < split; ++b) {
+            if (bins[b].count == 0) continue;
+            lMin = lMin.cwiseMin(bins[b].boxMin);
+            lMax = lMax.cwiseMax(bins[b].boxMax);
+            lCount += bins[b].count;
+        }
+        for (int b = split; b < BVH_NUM_BINS; ++b) {
+            if (bins[b].count == 0) continue;
+            rMin = rMin.cwiseMin(bins[b].boxMin);
+            rMax = rMax.cwiseMax(bins[b].boxMax);
+            rCount += bins[b].count;
+        }
+        if (lCount == 0 || rCount == 0) continue;
+
+        Real cost = lCount * boxArea(lMin, lMax) + rCount * boxArea(rMin, rMax);
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestSplit = split;
+        }
+    }
+
+    uint mid;
+    if (bestSplit < 0) {
+        // All centroids fell into one bin, fall back to a median split
+        mid = start + count / 2;
+        std::nth_element(triOrder.begin() + start, triOrder.begin() + mid, triOrder.begin() + start + count,
+            [&](uint a, uint b) { return centroids[a][axis] < centroids[b][axis]; });
+    } else {
+        auto it = std::partition(triOrder.begin() + start, triOrder.begin() + start + count,
+            [&](uint t) { return binOf(t) < bestSplit; });
+        mid = static_cast<uint>(it - triOrder.begin());
+    }
+
+    // Children are built depth first, so the left child always directly follows its parent
+    buildNode(centroids, start, mid - start, depth + 1);
+    uint right = buildNode(centroids, mid, start + count - mid, depth + 1);
+    nodes[nodeIdx].start = right;
+    nodes[nodeIdx].count = 0;
+
+    return nodeIdx;
+}
+
+template <typename NodeDistanceFn, typename VertexFn>
+bool MeshBVH::nearest(const VEC3F& p, NodeDistanceFn nodeDistance2, VertexFn vertex, const TriangleBatch* batch, ClosestHit* hit) const {
+    if (nodes.empty()) return false;
+
+    struct Entry {
+        Real dist2;
+        uint node;
+        bool operator<(const Entry& other) const { return dist2 > other.dist2; }
+    };
+    std::vector<Entry> heap;
+    heap.reserve(64);
+    heap.push_back({ nodeDistance2(nodes[0]), 0 });
+
+    Real minDistance = std::numeric_limits<Real>::max();
+    size_t nodesVisited = 0, trianglesTested = 0;
+    Real leafDistances2[BVH_LEAF_SIZE];
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        Entry entry = heap.back();
+        heap.pop_back();
+
+        // Best-first order: nothing left in the queue can be closer
+        if (entry.dist2 > minDistance * minDistance) break;
+
+        const Node& node = nodes[entry.node];
+        nodesVisited++;
+        if (node.count > 0) {
+            trianglesTested += node.count;
+            // Leaves cut short by the depth limit can be larger and test every triangle
+            bool batched = batch && node.count <= BVH_LEAF_SIZE;
+            Real leafSize = 0;
+            if (batched) {
+                batch->distances2(p, node.start, node.count, leafDistances2);
+                leafSize = (node.boxMax - node.boxMin).norm();
+            }
+            for (uint i = node.start; i < node.start + node.count; ++i) {
+                // Only triangles the batch cannot rule out get the exact test, which
+                // keeps the result identical to testing every one
+                Real reach = minDistance + leafSize;
+                if (batched && leafDistances2[i - node.start] > minDistance * minDistance * (1 + BATCH_DISTANCE_SLACK)
+                                                               + BATCH_DISTANCE_ROUNDING * reach * reach + 1e-30) continue;
+
+                uint t = triOrder[i];
+                TriangleFeature feature;
+                VEC3F candidate = closestPointOnTriangle(p, vertex(tris[3 * t]), vertex(tris[3 * t + 1]), vertex(tris[3 * t + 2]), &feature);
+                Real dist = (candidate - p).norm();
+                if (dist < minDistance) {
+                    minDistance = dist;
+                    hit->point = candidate;
+                    hit->triangle = t;
+                    hit->feature = feature;
+                }
+            }
+            continue;
+        }
+
+        uint children[2] = { entry.node + 1, node.start };
+        for (uint child : children) {
+            Real d2 = nodeDistance2(nodes[child]);
+            if (d2 <= minDistance * minDistance) {
+                heap.push_back({ d2, child });
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }
+
+    profileCount(PROFILE_BVH_NODES_VISITED, nodesVisited);
+    profileCount(PROFILE_TRIANGLES_TESTED, trianglesTested);
+
+    hit->distance = minDistance;
+    hit->normal = featureNormal(hit->triangle, hit->feature);
+    return true;
+}
+
+size_t MeshBVH::memoryBytes() const {
+    return nodes.size() * sizeof(Node) + leafTriangles.memoryBytes()
+         + (triOrder.size() + tris.size()) * sizeof(uint)
+         + (verts.size() + faceNormals.size() + edgeNormals.size() + vertexNormals.size()) * sizeof(VEC3F);
+}
+
+bool MeshBVH::bounds(VEC3F* boxMin, VEC3F* boxMax) const {
+    if (nodes.empty()) return false;
+    *boxMin = nodes[0].boxMin;
+    *boxMax = nodes[0].boxMax;
+    return true;
+}
+
+bool MeshBVH::closestPoint(const VEC3F& p, ClosestHit* hit) const {
+    return nearest(p,
+        [&](const Node& node) { return boxDistance2(p, node.boxMin, node.boxMax); },
+        [&](uint v) -> const VEC3F& { return verts[v]; },
+        &leafTriangles, hit);
+}
+
+bool MeshBVH::closestPoint(const VEC3F& p, const MAT4& xform, ClosestHit* hit) const {
+    Matrix<Real, 3, 3> linear = xform.block<3, 3>(0, 0);
+    Matrix<Real, 3, 3> absLinear = linear.cwiseAbs();
+    VEC3F translation = xform.block<3, 1>(0, 3);
+
+    // Box of the transformed node (Arvo's method), distance is a lower bound for its triangles
+    bool found = nearest(p,
+        [&](const Node& node) {
+            VEC3F center = linear * ((node.boxMin + node.boxMax) * 0.5) + translation;
+            VEC3F halfExtent = absLinear * ((node.boxMax - node.boxMin) * 0.5);
+            return boxDistance2(p, center - halfExtent, center + halfExtent);
+        },
+        [&](uint v) { return transformPoint(xform, verts[v]); },
+        nullptr, hit);
+
+    // Normals transform with the inverse transpose, which keeps them on the outside
+    // even for mirroring transforms
+    if (found) hit->normal = linear.inverse().transpose() * hit->normal;
+    return found;
+}
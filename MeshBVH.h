@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+#include "PortalMap.h"
+#include "TriangleBatch.h"
+
+// Triangle feature the closest point lies on
+enum TriangleFeature {
+    TRI_VERTEX_A, TRI_VERTEX_B, TRI_VERTEX_C,
+    TRI_EDGE_AB, TRI_EDGE_BC, TRI_EDGE_CA,
+    TRI_FACE
+};
+
+// Closest point on triangle ABC to point P (Ericson, Real-Time Collision Detection 5.1.5)
+VEC3F closestPointOnTriangle(const VEC3F& p, const VEC3F& a, const VEC3F& b, const VEC3F& c, TriangleFeature* feature = nullptr);
+
+// Bounding volume hierarchy over the triangles of an indexed mesh.
+// Built once per mesh and used for best-first nearest triangle queries.
+class MeshBVH {
+public:
+    struct Node {
+        VEC3F boxMin;
+        VEC3F boxMax;
+        uint start;     // right child for interior nodes (left child is the next node), first entry of triOrder for leaves
+        uint count;     // number of triangles for leaves, 0 for interior nodes
+    };
+
+    struct ClosestHit {
+        VEC3F point;
+        VEC3F normal;       // angle-weighted pseudo-normal of the closest feature (unnormalized)
+        Real distance;
+        uint triangle;
+        TriangleFeature feature;
+    };
+
+    void build(const std::vector<VEC3F>& vertices, const std::vector<uint>& indices);
+    void clear();
+    bool empty() const { return nodes.empty(); }
+
+    // Closest point on the mesh to p. Returns false if the BVH holds no triangles.
+    bool closestPoint(const VEC3F& p, ClosestHit* hit) const;
+
+    // Same query with every vertex mapped through the affine transform xform first
+    bool closestPoint(const VEC3F& p, const MAT4& xform, ClosestHit* hit) const;
+
+    // Signed distance from the pseudo-normal of the closest feature, positive inside.
+    // Stays well defined on open and non-manifold meshes.
+    static Real signedDistance(const VEC3F& p, const ClosestHit& hit);
+
+    // Box around every triangle. Returns false if the BVH holds no triangles.
+    bool bounds(VEC3F* boxMin, VEC3F* boxMax) const;
+
+    size_t numTriangles() const { return tris.size() / 3; }
+    size_t memoryBytes() const;
+
+private:
+    uint buildNode(std::vector<VEC3F>& centroids, uint start, uint count, int depth);
+
+    void computePseudoNormals();
+    const VEC3F& featureNormal(uint triangle, TriangleFeature feature) const;
+
+    // batch, if given, holds the triangles as vertex() returns them and rules out
+    // leaf triangles before the exact test
+    template <typename NodeDistanceFn, typename VertexFn>
+    bool nearest(const VEC3F& p, NodeDistanceFn nodeDistance2, VertexFn vertex, const TriangleBatch* batch, ClosestHit* hit) const;
+
+    std::vector<Node> nodes;
+    std::vector<uint> triOrder;     // triangle ids ordered so every leaf is a contiguous range
+    std::vector<VEC3F> verts;
+    std::vector<uint> tris;
+    TriangleBatch leafTriangles;        // triangles in triOrder order
+
+    // Pseudo-normals (Baerentzen and Aanaes 2005) for sign determination
+    std::vector<VEC3F> faceNormals;     // one per triangle
+    std::vector<VEC3F> edgeNormals;     // three per triangle, edges AB, BC, CA
+    std::vector<VEC3F> vertexNormals;   // angle weighted, one per vertex
+};
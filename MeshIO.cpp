@@ -0,0 +1,434 @@
+#include "MeshIO.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static std::string extensionOf(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return "";
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext;
+}
+
+// Common tail of the readers: bounds, and the vertices UVs are transferred from
+static void finishMesh(Mesh* mesh) {
+    mesh->computeBounds();
+    mesh->originalVertices = mesh->vertices;
+    if (mesh->uvU.size() != mesh->vertices.size()) {
+        mesh->uvU.clear();
+        mesh->uvV.clear();
+    }
+    if (mesh->normals.size() != mesh->vertices.size()) {
+        mesh->normals.clear();
+    }
+}
+
+// 1-based, or negative relative to the end of the list so far
+static bool resolveObjIndex(long index, size_t count, size_t* resolved) {
+    if (index > 0 && (size_t)index <= count) {
+        *resolved = (size_t)index - 1;
+        return true;
+    }
+    if (index < 0 && (size_t)(-index) <= count) {
+        *resolved = count + index;
+        return true;
+    }
+    return false;
+}
+
+bool readOBJ(const std::string& path, Mesh* mesh, std::string* error) {
+    std::ifstream in(path);
+    if (!in) {
+        *error = "cannot open " + path;
+        return false;
+    }
+
+    *mesh = Mesh();
+    std::vector<VEC2F> texCoords;
+    std::vector<VEC3F> fileNormals;
+    std::vector<VEC3F> vertexNormals;
+    std::vector<uint> face;
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        std::istringstream tokens(line);
+        std::string tag;
+        if (!(tokens >> tag) || tag[0] == '#') continue;
+
+        if (tag == "v") {
+            Real x, y, z;
+            if (!(tokens >> x >> y >> z)) {
+                *error = path + ":" + std::to_string(lineNumber) + ": bad vertex";
+                return false;
+            }
+            mesh->vertices.emplace_back(x, y, z);
+        } else if (tag == "vt") {
+            Real u = 0, v = 0;
+            tokens >> u >> v;
+            texCoords.emplace_back(u, v);
+        } else if (tag == "vn") {
+            Real x = 0, y = 0, z = 0;
+            tokens >> x >> y >> z;
+            fileNormals.emplace_back(x, y, z);
+        } else if (tag == "f") {
+            // v, v/vt, v//vn or v/vt/vn per corner
+            face.clear();
+            std::string corner;
+            while (tokens >> corner) {
+                long refs[3] = { 0, 0, 0 };
+                size_t start = 0;
+                for (int r = 0; r < 3 && start <= corner.size(); ++r) {
+                    size_t slash = corner.find('/', start);
+                    std::string part = corner.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+                    if (!part.empty()) refs[r] = std::strtol(part.c_str(), nullptr, 10);
+                    if (slash == std::string::npos) break;
+                    start = slash + 1;
+                }
+
+                size_t vertex, ref;
+                if (!resolveObjIndex(refs[0], mesh->vertices.size(), &vertex)) {
+                    *error = path + ":" + std::to_string(lineNumber) + ": vertex index out of range";
+                    return false;
+                }
+                if (refs[1] != 0 && resolveObjIndex(refs[1], texCoords.size(), &ref)) {
+                    mesh->uvU.resize(mesh->vertices.size(), 0.0f);
+                    mesh->uvV.resize(mesh->vertices.size(), 0.0f);
+                    mesh->uvU[vertex] = (float)texCoords[ref][0];
+                    mesh->uvV[vertex] = (float)texCoords[ref][1];
+                }
+                if (refs[2] != 0 && resolveObjIndex(refs[2], fileNormals.size(), &ref)) {
+                    vertexNormals.resize(mesh->vertices.size(), VEC3F(0, 0, 0));
+                    vertexNormals[vertex] = fileNormals[ref];
+                }
+                face.push_back((uint)vertex);
+            }
+
+            for (size_t i = 1; i + 1 < face.size(); ++i) {
+                mesh->indices.push_back(face[0]);
+                mesh->indices.push_back(face[i]);
+                mesh->indices.push_back(face[i + 1]);
+            }
+        }
+    }
+
+    // Vertices declared after their last face reference still need an entry
+    if (!mesh->uvU.empty()) {
+        mesh->uvU.resize(mesh->vertices.size(), 0.0f);
+        mesh->uvV.resize(mesh->vertices.size(), 0.0f);
+    }
+    if (!vertexNormals.empty()) {
+        vertexNormals.resize(mesh->vertices.size(), VEC3F(0, 0, 0));
+    }
+    mesh->normals = vertexNormals;
+    finishMesh(mesh);
+    return true;
+}
+
+bool writeOBJ(const std::string& path, const Mesh& mesh, std::string* error) {
+    std::ofstream out(path);
+    if (!out) {
+        *error = "cannot write " + path;
+        return false;
+    }
+
+    std::vector<float> u, v;
+    mesh.transferUVs(&u, &v);
+    bool hasNormals = mesh.normals.size() == mesh.vertices.size();
+
+    out.precision(9);
+    for (const VEC3F& p : mesh.vertices) {
+        out << "v " << p[0] << " " << p[1] << " " << p[2] << "\n";
+    }
+    for (size_t i = 0; i < u.size(); ++i) {
+        out << "vt " << u[i] << " " << v[i] << "\n";
+    }
+    if (hasNormals) {
+        for (const VEC3F& n : mesh.normals) {
+            out << "vn " << n[0] << " " << n[1] << " " << n[2] << "\n";
+        }
+    }
+
+    // Texture coordinates and normals share the vertex numbering
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        out << "f";
+        for (int c = 0; c < 3; ++c) {
+            uint index = mesh.indices[i + c] + 1;
+            out << " " << index;
+            if (!u.empty() && hasNormals) out << "/" << index << "/" << index;
+            else if (!u.empty()) out << "/" << index;
+            else if (hasNormals) out << "//" << index;
+        }
+        out << "\n";
+    }
+
+    if (!out) {
+        *error = "failed writing " + path;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+enum PlyFormat { PLY_ASCII, PLY_BINARY_LE, PLY_BINARY_BE };
+
+struct PlyProperty {
+    std::string name;
+    std::string type;
+    std::string countType;  // list properties only
+    bool isList = false;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+size_t plyTypeSize(const std::string& type) {
+    if (type == "char" || type == "uchar" || type == "int8" || type == "uint8") return 1;
+    if (type == "short" || type == "ushort" || type == "int16" || type == "uint16") return 2;
+    if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32") return 4;
+    if (type == "double" || type == "float64") return 8;
+    return 0;
+}
+
+// Reads one scalar of the given type as a double
+bool readPlyScalar(std::istream& in, PlyFormat format, const std::string& type, double* value) {
+    if (format == PLY_ASCII) {
+        return (bool)(in >> *value);
+    }
+
+    size_t size = plyTypeSize(type);
+    unsigned char bytes[8];
+    if (size == 0 || !in.read(reinterpret_cast<char*>(bytes), size)) return false;
+
+    // Assemble in little endian order, whatever the host is
+    uint64_t raw = 0;
+    for (size_t i = 0; i < size; ++i) {
+        size_t b = format == PLY_BINARY_LE ? i : size - 1 - i;
+        raw |= (uint64_t)bytes[b] << (8 * i);
+    }
+
+    if (type == "float" || type == "float32") {
+        uint32_t bits = (uint32_t)raw;
+        float f;
+        std::memcpy(&f, &bits, 4);
+        *value = f;
+    } else if (type == "double" || type == "float64") {
+        double d;
+        std::memcpy(&d, &raw, 8);
+        *value = d;
+    } else if (type == "char" || type == "int8") {
+        *value = (int8_t)raw;
+    } else if (type == "short" || type == "int16") {
+        *value = (int16_t)raw;
+    } else if (type == "int" || type == "int32") {
+        *value = (int32_t)raw;
+    } else {
+        *value = (double)raw;
+    }
+    return true;
+}
+
+void writeLittleEndian(std::ostream& out, uint32_t bits) {
+    unsigned char bytes[4] = { (unsigned char)bits, (unsigned char)(bits >> 8), (unsigned char)(bits >> 16), (unsigned char)(bits >> 24) };
+    out.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+void writeFloat(std::ostream& out, Real value) {
+    float f = (float)value;
+    uint32_t bits;
+    std::memcpy(&bits, &f, 4);
+    writeLittleEndian(out, bits);
+}
+
+}
+
+bool readPLY(const std::string& path, Mesh* mesh, std::string* error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        *error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 3, "ply") != 0) {
+        *error = path + " is not a PLY file";
+        return false;
+    }
+
+    PlyFormat format = PLY_ASCII;
+    std::vector<PlyElement> elements;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if (keyword == "format") {
+            std::string name;
+            tokens >> name;
+            if (name == "ascii") format = PLY_ASCII;
+            else if (name == "binary_little_endian") format = PLY_BINARY_LE;
+            else if (name == "binary_big_endian") format = PLY_BINARY_BE;
+            else {
+                *error = path + ": unknown PLY format " + name;
+                return false;
+            }
+        } else if (keyword == "element") {
+            PlyElement element;
+            tokens >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            PlyProperty property;
+            tokens >> property.type;
+            if (property.type == "list") {
+                property.isList = true;
+                tokens >> property.countType >> property.type;
+            }
+            tokens >> property.name;
+            if (plyTypeSize(property.type) == 0 || (property.isList && plyTypeSize(property.countType) == 0)) {
+                *error = path + ": unsupported PLY property type in '" + line + "'";
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            break;
+        }
+    }
+
+    *mesh = Mesh();
+    std::vector<uint> face;
+    for (const PlyElement& element : elements) {
+        bool isVertex = element.name == "vertex";
+        bool isFace = element.name == "face";
+        for (size_t e = 0; e < element.count; ++e) {
+            VEC3F position(0, 0, 0), normal(0, 0, 0);
+            double uv[2] = { 0, 0 };
+            bool hasNormal = false, hasUV = false;
+            face.clear();
+
+            for (const PlyProperty& property : element.properties) {
+                double value;
+                if (property.isList) {
+                    double count;
+                    if (!readPlyScalar(in, format, property.countType, &count)) break;
+                    bool isIndexList = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                    for (size_t i = 0; i < (size_t)count; ++i) {
+                        if (!readPlyScalar(in, format, property.type, &value)) break;
+                        if (isIndexList) face.push_back((uint)value);
+                    }
+                    continue;
+                }
+
+                if (!readPlyScalar(in, format, property.type, &value)) break;
+                if (!isVertex) continue;
+                const std::string& name = property.name;
+                if (name == "x") position[0] = value;
+                else if (name == "y") position[1] = value;
+                else if (name == "z") position[2] = value;
+                else if (name == "nx") { normal[0] = value; hasNormal = true; }
+                else if (name == "ny") normal[1] = value;
+                else if (name == "nz") normal[2] = value;
+                else if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s") { uv[0] = value; hasUV = true; }
+                else if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t") uv[1] = value;
+            }
+
+            if (!in) {
+                *error = path + ": unexpected end of " + element.name + " data";
+                return false;
+            }
+
+            if (isVertex) {
+                mesh->vertices.push_back(position);
+                if (hasNormal) mesh->normals.push_back(normal);
+                if (hasUV) {
+                    mesh->uvU.push_back((float)uv[0]);
+                    mesh->uvV.push_back((float)uv[1]);
+                }
+            } else if (isFace) {
+                for (size_t i = 1; i + 1 < face.size(); ++i) {
+                    mesh->indices.push_back(face[0]);
+                    mesh->indices.push_back(face[i]);
+                    mesh->indices.push_back(face[i + 1]);
+                }
+            }
+        }
+    }
+
+    for (uint index : mesh->indices) {
+        if (index >= mesh->vertices.size()) {
+            *error = path + ": face index out of range";
+            return false;
+        }
+    }
+
+    finishMesh(mesh);
+    return true;
+}
+
+bool writePLY(const std::string& path, const Mesh& mesh, std::string* error) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        *error = "cannot write " + path;
+        return false;
+    }
+
+    std::vector<float> u, v;
+    mesh.transferUVs(&u, &v);
+    bool hasNormals = mesh.normals.size() == mesh.vertices.size();
+    size_t numFaces = mesh.indices.size() / 3;
+
+    out << "ply\nformat binary_little_endian 1.0\n";
+    out << "element vertex " << mesh.vertices.size() << "\n";
+    out << "property float x\nproperty float y\nproperty float z\n";
+    if (hasNormals) out << "property float nx\nproperty float ny\nproperty float nz\n";
+    if (!u.empty()) out << "property float s\nproperty float t\n";
+    out << "element face " << numFaces << "\n";
+    out << "property list uchar int vertex_indices\nend_header\n";
+
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        for (int c = 0; c < 3; ++c) writeFloat(out, mesh.vertices[i][c]);
+        if (hasNormals) {
+            for (int c = 0; c < 3; ++c) writeFloat(out, mesh.normals[i][c]);
+        }
+        if (!u.empty()) {
+            writeFloat(out, u[i]);
+            writeFloat(out, v[i]);
+        }
+    }
+    for (size_t f = 0; f < numFaces; ++f) {
+        out.put(3);
+        for (int c = 0; c < 3; ++c) writeLittleEndian(out, mesh.indices[3 * f + c]);
+    }
+
+    if (!out) {
+        *error = "failed writing " + path;
+        return false;
+    }
+    return true;
+}
+
+bool readMesh(const std::string& path, Mesh* mesh, std::string* error) {
+    std::string ext = extensionOf(path);
+    if (ext == "obj") return readOBJ(path, mesh, error);
+    if (ext == "ply") return readPLY(path, mesh, error);
+    *error = "unknown mesh format: " + path + " (expected .obj or .ply)";
+    return false;
+}
+
+bool writeMesh(const std::string& path, const Mesh& mesh, std::string* error) {
+    std::string ext = extensionOf(path);
+    if (ext == "obj") return writeOBJ(path, mesh, error);
+    if (ext == "ply") return writePLY(path, mesh, error);
+    *error = "unknown mesh format: " + path + " (expected .obj or .ply)";
+    return false;
+}
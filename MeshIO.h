@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "mesh.h"
+
+// Wavefront OBJ and Stanford PLY mesh files. Polygons are fan triangulated on
+// load; per-vertex texture coordinates are kept in uvU/uvV and the vertices copied
+// to originalVertices, so generated meshes can inherit them through Mesh::fromMesh.
+// All functions return false and describe the problem in error on failure.
+
+bool readOBJ(const std::string& path, Mesh* mesh, std::string* error);
+bool writeOBJ(const std::string& path, const Mesh& mesh, std::string* error);
+
+// ASCII and binary PLY
+bool readPLY(const std::string& path, Mesh* mesh, std::string* error);
+// Binary little endian PLY
+bool writePLY(const std::string& path, const Mesh& mesh, std::string* error);
+
+// Picks the format from the file extension
+bool readMesh(const std::string& path, Mesh* mesh, std::string* error);
+bool writeMesh(const std::string& path, const Mesh& mesh, std::string* error);
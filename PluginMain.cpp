@@ -100,6 +100,24 @@ void createSelectionUI(MStatus* status) {
                         -enable true
                         -width 200
                         -wordWrap true;
+
+                    // Julia Blend Slider
+                    floatSliderGrp -label "Julia Blend" -field true -minValue 0 -maxValue 1 -value 0.0 -step 0.01 -precision 2 -columnAlign3 "left" "left" "left" ("myJuliaBlendSlider_" + $nodeID);
+                    text
+                        -align "left"
+                        -label "    Weight of the quaternion Julia set carved into the mesh, from none (0) to the Julia set alone (1)."
+                        -enable true
+                        -width 200
+                        -wordWrap true;
+
+                    // Julia Scale Slider
+                    floatSliderGrp -label "Julia Scale" -field true -minValue 0.01 -maxValue 10 -value 1.0 -step 0.01 -precision 2 -columnAlign3 "left" "left" "left" ("myJuliaScaleSlider_" + $nodeID);
+                    text
+                        -align "left"
+                        -label "    Size of the Julia set relative to the mesh, centred on its origin."
+                        -enable true
+                        -width 200
+                        -wordWrap true;
                     
                     // RowLayout for Delete Button (centered)
                     rowLayout -numberOfColumns 1 -columnAlign1 "center";
@@ -179,6 +197,13 @@ void createSelectionUI(MStatus* status) {
         ////////////////////////////////////////////////////////////////////////
         global proc onGeneratePressed() {
             int $lowResMode = `checkBox -q -value "myToggleCheckbox"`;
+            int $numThreads = `intSliderGrp -q -value "myThreadsSlider"`;
+            float $voxelSize = `floatSliderGrp -q -value "myVoxelSizeSlider"`;
+            int $voxelBudget = `intSliderGrp -q -value "myVoxelBudgetSlider"`;
+            string $mesher = (`optionMenu -q -select "myMesherMenu"` == 2) ? "dc" : "mc";
+            float $simplifyError = `floatSliderGrp -q -value "mySimplifyErrorSlider"`;
+            string $separatePasses = `checkBox -q -value "mySeparatePassesCheckbox"` ? " -separatePasses" : "";
+            string $bakeNoise = `checkBox -q -value "myBakeNoiseCheckbox"` ? " -bakeNoise" : "";
 
             global int $nodeCounter;
             int $numNodes = $nodeCounter - 1;
@@ -196,6 +221,8 @@ void createSelectionUI(MStatus* status) {
                 string $versorScaleField = "myVersorScaleSlider_" + $i;
                 string $versorOctaveField = "myVersorOctaveSlider_" + $i;
                 string $numIterationField = "myNumIterationSlider_" + $i;
+                string $juliaBlendField = "myJuliaBlendSlider_" + $i;
+                string $juliaScaleField = "myJuliaScaleSlider_" + $i;
 
                 string $portalName = ("portalCube_" + $i);
                 string $selectedObject = `textFieldButtonGrp -q -text $selField`;
@@ -216,6 +243,8 @@ void createSelectionUI(MStatus* status) {
                 float $versorScale = `floatSliderGrp -q -value $versorScaleField`;
                 int $versorOctave = `intSliderGrp -q -value $versorOctaveField`;
                 int $numIterations = `intSliderGrp -q -value $numIterationField`;
+                float $juliaBlend = `floatSliderGrp -q -value $juliaBlendField`;
+                float $juliaScale = `floatSliderGrp -q -value $juliaScaleField`;
                 
                 string $cmd = ("FractalCmd \"" + $selectedObject + "\" " 
                                + $posX + " " + $posY + " " + $posZ + " " 
@@ -223,7 +252,16 @@ void createSelectionUI(MStatus* status) {
                                + $scaleX + " " + $scaleY + " " + $scaleZ + " " 
                                + $alpha + " " + $beta + " " + $versorScale + " " 
                                + $versorOctave + " " + $numIterations + " "
-                               + $lowResMode);
+                               + $lowResMode
+                               + " -threads " + $numThreads
+                               + " -voxelSize " + $voxelSize
+                               + " -voxelBudget " + $voxelBudget
+                               + " -mesher " + $mesher
+                               + " -simplifyError " + $simplifyError
+                               + " -juliaBlend " + $juliaBlend
+                               + " -juliaScale " + $juliaScale
+                               + $separatePasses
+                               + $bakeNoise);
                 print ("Executing for node " + $i + ": " + $cmd + "\n");
                 eval($cmd);
             }
@@ -270,8 +308,75 @@ void createSelectionUI(MStatus* status) {
                     -annotation "When on, passes a 1 to FractalCmd; otherwise 0"
                     "myToggleCheckbox";
 
+                intSliderGrp
+                    -label "Threads"
+                    -field true
+                    -minValue 0
+                    -maxValue 64
+                    -value 0
+                    -annotation "Worker threads used for field sampling, 0 uses every core"
+                    -columnAlign3 "left" "left" "left"
+                    "myThreadsSlider";
+
+                floatSliderGrp
+                    -label "Voxel Size"
+                    -field true
+                    -minValue 0.0
+                    -maxValue 1.0
+                    -fieldMaxValue 100.0
+                    -precision 3
+                    -value 0.0
+                    -annotation "Edge length of a grid cell, 0 derives it from the voxel budget"
+                    -columnAlign3 "left" "left" "left"
+                    "myVoxelSizeSlider";
+
+                intSliderGrp
+                    -label "Voxel Budget"
+                    -field true
+                    -minValue 1000
+                    -maxValue 1000000
+                    -fieldMaxValue 100000000
+                    -value 125000
+                    -annotation "Approximate number of grid cells per pass when no voxel size is set"
+                    -columnAlign3 "left" "left" "left"
+                    "myVoxelBudgetSlider";
+
+                optionMenu
+                    -label "Mesher"
+                    -annotation "Uniform marching cubes, or adaptive dual contouring with fewer triangles"
+                    "myMesherMenu";
+                    menuItem -label "Marching Cubes";
+                    menuItem -label "Dual Contouring";
+
+                floatSliderGrp
+                    -label "Simplify Error"
+                    -field true
+                    -minValue 0.0
+                    -maxValue 1.0
+                    -precision 2
+                    -value 0.1
+                    -annotation "Dual contouring only: surface error allowed when merging cells, in finest cells"
+                    -columnAlign3 "left" "left" "left"
+                    "mySimplifyErrorSlider";
+
+                checkBox
+                    -label "Separate Passes"
+                    -value false
+                    -annotation "Mesh every portal copy on its own instead of their union in one pass"
+                    "mySeparatePassesCheckbox";
+
+                checkBox
+                    -label "Bake Noise"
+                    -value false
+                    -annotation "Read the noise from a grid baked once per noise setting, within 0.01 of exact"
+                    "myBakeNoiseCheckbox";
+
                 button -label "Generate" -command "onGeneratePressed";
 
+                // Generation runs in the background; one bar for the running job
+                progressBar -maxValue 100 -annotation "Progress of the running fractal job" "myFractalProgress";
+                button -label "Cancel" -command "FractalCmd -cancel";
+
             showWindow mySelectionWindow;
         }
     )";
@@ -320,6 +425,9 @@ MStatus uninitializePlugin(MObject obj)
     MStatus status = MStatus::kSuccess;
     MFnPlugin plugin(obj);
 
+    // Background jobs hold generators from this library, stop them before it goes
+    cancelFractalJobs();
+
     status = plugin.deregisterCommand("FractalCmd");
     if (!status) {
         status.perror("deregisterCommand");
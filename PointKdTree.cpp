@@ -0,0 +1,82 @@
+#include "PointKdTree.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#define KD_LEAF_SIZE 8
+
+void PointKdTree::build(const std::vector<VEC3F>& input) {
+    points = input;
+    order.resize(input.size());
+    std::iota(order.begin(), order.end(), 0u);
+    splitAxis.assign(input.size(), 0);
+    if (!input.empty()) buildRange(0, (uint)input.size());
+
+    // Store the points in tree order so leaves are scanned contiguously
+    for (size_t i = 0; i < order.size(); ++i) {
+        points[i] = input[order[i]];
+    }
+}
+
+void PointKdTree::clear() {
+    points.clear();
+    order.clear();
+    splitAxis.clear();
+}
+
+void PointKdTree::buildRange(uint start, uint end) {
+    if (end - start <= KD_LEAF_SIZE) return;
+
+    // Split the longest side of the range's bounding box at the median
+    VEC3F lo = points[order[start]], hi = lo;
+    for (uint i = start + 1; i < end; ++i) {
+        lo = lo.cwiseMin(points[order[i]]);
+        hi = hi.cwiseMax(points[order[i]]);
+    }
+    int axis;
+    (hi - lo).maxCoeff(&axis);
+
+    uint middle = start + (end - start) / 2;
+    std::nth_element(order.begin() + start, order.begin() + middle, order.begin() + end,
+        [&](uint a, uint b) { return points[a][axis] < points[b][axis]; });
+    splitAxis[middle] = (unsigned char)axis;
+
+    buildRange(start, middle);
+    buildRange(middle + 1, end);
+}
+
+void PointKdTree::search(uint start, uint end, const VEC3F& p, Real* bestDist2, uint* best) const {
+    auto visit = [&](uint i) {
+        Real d2 = (p - points[i]).squaredNorm();
+        if (d2 < *bestDist2 || (d2 == *bestDist2 && order[i] < *best)) {
+            *bestDist2 = d2;
+            *best = order[i];
+        }
+    };
+
+    if (end - start <= KD_LEAF_SIZE) {
+        for (uint i = start; i < end; ++i) visit(i);
+        return;
+    }
+
+    uint middle = start + (end - start) / 2;
+    int axis = splitAxis[middle];
+    Real offset = p[axis] - points[middle][axis];
+    visit(middle);
+
+    // Near side first; the far side only if it can hold an equally close point
+    if (offset < 0) {
+        search(start, middle, p, bestDist2, best);
+        if (offset * offset <= *bestDist2) search(middle + 1, end, p, bestDist2, best);
+    } else {
+        search(middle + 1, end, p, bestDist2, best);
+        if (offset * offset <= *bestDist2) search(start, middle, p, bestDist2, best);
+    }
+}
+
+uint PointKdTree::nearest(const VEC3F& p) const {
+    Real bestDist2 = std::numeric_limits<Real>::max();
+    uint best = 0;
+    search(0, (uint)points.size(), p, &bestDist2, &best);
+    return best;
+}
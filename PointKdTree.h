@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+
+// Balanced k-d tree over a point set for exact nearest point queries, e.g. to
+// carry per-vertex attributes from an input mesh over to a generated one.
+// Built once; queries are read-only and can run from many threads.
+class PointKdTree {
+public:
+    void build(const std::vector<VEC3F>& points);
+    void clear();
+
+    bool empty() const { return points.empty(); }
+    size_t size() const { return points.size(); }
+
+    // Index into the built point set of the point nearest to p, the lowest index
+    // on ties, so results match a brute force scan. The tree must not be empty.
+    uint nearest(const VEC3F& p) const;
+
+private:
+    void buildRange(uint start, uint end);
+    void search(uint start, uint end, const VEC3F& p, Real* bestDist2, uint* best) const;
+
+    // Implicit tree: the median of every range [start, end) sits at its middle and
+    // splits it along splitAxis[middle]
+    std::vector<VEC3F> points;
+    std::vector<uint> order;            // original index of each point
+    std::vector<unsigned char> splitAxis;
+};
@@ -40,7 +40,7 @@ void PortalMap::setRotMat(MAT4* mat, double rx, double ry, double rz) {
 
     // Convert to 4x4 matrix
     *mat = MAT4::Identity();
-    mat->block<3, 3>(0, 0) = rotation;
+    mat->block<3, 3>(0, 0) = rotation.cast<Real>();
 }
 
 // need to confirm about the col major mat
@@ -52,6 +52,7 @@ void PortalMap::setTransMat(MAT4* mat, double tx, double ty, double tz) {
 void PortalMap::createTransformMat(MAT4 scaleMat, MAT4 rotMat, MAT4 transMat) {
     TransformMats transforms = {scaleMat, rotMat, transMat, transMat * rotMat * scaleMat};
     portalTransforms.emplace_back(transforms);
+    invalidateTransforms(portalTransforms.size() - 1);
 }
 
 void PortalMap::addPortal(double tx, double ty, double tz, double rx, double ry, double rz, double sx, double sy, double sz) {
@@ -67,38 +68,70 @@ void PortalMap::setTransformMat(size_t idx, MAT4 scaleMat, MAT4 rotMat, MAT4 tra
     portalTransforms[idx].rotMat = rotMat;
     portalTransforms[idx].transMat = transMat;
     portalTransforms[idx].transformMat = transMat * rotMat * scaleMat;
+    invalidateTransforms(idx);
 }
 
-VEC3F PortalMap::getFieldValue(const VEC3F& pos, size_t idx, size_t num_iter) const {
-    VEC4F posWorld;
-    posWorld << pos[0], pos[1], pos[2], 1.0;
+void PortalMap::invalidateTransforms(size_t idx) {
+    if (transformCache.size() < portalTransforms.size()) {
+        transformCache.resize(portalTransforms.size());
+    }
+    transformCache[idx].clear();
+}
 
-    MAT4 trans = portalTransforms[idx].transformMat;
-    for (size_t i = 1; i < num_iter; ++i) {
-        trans *= trans;
+const PortalMap::IterationTransform& PortalMap::cachedTransform(size_t idx, size_t num_iter) const {
+    static const IterationTransform identity = { MAT4::Identity(), MAT4::Identity() };
+    if (num_iter == 0) return identity;
+
+    if (transformCache.size() < portalTransforms.size()) {
+        transformCache.resize(portalTransforms.size());
     }
 
-    VEC4F posNew = trans * posWorld;
+    // Iteration i applies the portal transform squared i - 1 times
+    std::vector<IterationTransform>& table = transformCache[idx];
+    if (table.empty()) {
+        IterationTransform first = { portalTransforms[idx].transformMat, portalTransforms[idx].transformMat.inverse() };
+        table.push_back(first);
+    }
+    while (table.size() < num_iter) {
+        IterationTransform next = table.back();
+        next.forward *= next.forward;
+        next.inverse *= next.inverse;
+        table.push_back(next);
+    }
 
-    VEC3F posReturn;
-    posReturn << posNew[0], posNew[1], posNew[2];
+    return table[num_iter - 1];
+}
 
-    return posReturn;
+void PortalMap::precomputeTransforms(size_t idx, size_t num_iter) const {
+    cachedTransform(idx, num_iter);
 }
 
-VEC3F PortalMap::getInvFieldValue(const VEC3F& pos, size_t idx, size_t num_iter) const {
-    VEC4F posWorld;
-    posWorld << pos[0], pos[1], pos[2], 1.0;
+MAT4 PortalMap::getTransform(size_t idx, size_t num_iter) const {
+    return cachedTransform(idx, num_iter).forward;
+}
 
-    MAT4 trans = portalTransforms[idx].transformMat.inverse();
-    for (size_t i = 1; i < num_iter; ++i) {
-        trans *= trans;
-    }
-    VEC4F posNew = trans * posWorld;
+MAT4 PortalMap::getInvTransform(size_t idx, size_t num_iter) const {
+    return cachedTransform(idx, num_iter).inverse;
+}
 
-    VEC3F posReturn;
-    posReturn << posNew[0], posNew[1], posNew[2];
+VEC3F PortalMap::getFieldValue(const VEC3F& pos, size_t idx, size_t num_iter) const {
+    return transformPoint(cachedTransform(idx, num_iter).forward, pos);
+}
 
-    return posReturn;
+VEC3F PortalMap::getInvFieldValue(const VEC3F& pos, size_t idx, size_t num_iter) const {
+    return transformPoint(cachedTransform(idx, num_iter).inverse, pos);
 }
 
+void PortalMap::getFieldValues(const VEC3F* pos, VEC3F* out, size_t count, size_t idx, size_t num_iter) const {
+    const MAT4 trans = cachedTransform(idx, num_iter).forward;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = transformPoint(trans, pos[i]);
+    }
+}
+
+void PortalMap::getInvFieldValues(const VEC3F* pos, VEC3F* out, size_t count, size_t idx, size_t num_iter) const {
+    const MAT4 trans = cachedTransform(idx, num_iter).inverse;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = transformPoint(trans, pos[i]);
+    }
+}
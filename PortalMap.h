@@ -11,6 +11,19 @@ typedef struct {
     MAT4 transformMat;
 } TransformMats;
 
+// Applies an affine 4x4 transform to a point
+inline VEC3F transformPoint(const MAT4& mat, const VEC3F& pos) {
+    VEC4F posWorld;
+    posWorld << pos[0], pos[1], pos[2], 1.0;
+
+    VEC4F posNew = mat * posWorld;
+
+    VEC3F posReturn;
+    posReturn << posNew[0], posNew[1], posNew[2];
+
+    return posReturn;
+}
+
 class PortalMap {
 public:
     PortalMap();
@@ -20,6 +33,17 @@ public:
 
     VEC3F getInvFieldValue(const VEC3F& pos, size_t idx, size_t num_iter) const;
 
+    // Batch versions, transforming count points with a single cached matrix
+    void getFieldValues(const VEC3F* pos, VEC3F* out, size_t count, size_t idx, size_t num_iter) const;
+    void getInvFieldValues(const VEC3F* pos, VEC3F* out, size_t count, size_t idx, size_t num_iter) const;
+
+    // Transform applied by getFieldValue / getInvFieldValue for a given portal and iteration.
+    // Filled lazily into a per-portal table, so concurrent callers must precompute first.
+    // Iteration 0 is the identity of every portal, i.e. the input mesh itself.
+    MAT4 getTransform(size_t idx, size_t num_iter) const;
+    MAT4 getInvTransform(size_t idx, size_t num_iter) const;
+    void precomputeTransforms(size_t idx, size_t num_iter) const;
+
     void setTransMat(MAT4* mat, double tx, double ty, double tz);
     void setScaleMat(MAT4* mat, double sx, double sy, double sz);
     void setRotMat(MAT4* mat, double rx, double ry, double rz);
@@ -37,4 +61,16 @@ public:
     std::vector<VEC3F>          portalCenters;
     std::vector<TransformMats>  portalTransforms;
     std::vector<double>         portalRadius;
+
+private:
+    struct IterationTransform {
+        MAT4 forward;
+        MAT4 inverse;
+    };
+
+    const IterationTransform& cachedTransform(size_t idx, size_t num_iter) const;
+    void invalidateTransforms(size_t idx);
+
+    // transformCache[idx][i] holds the transforms of iteration i + 1 of portal idx
+    mutable std::vector<std::vector<IterationTransform>> transformCache;
 };
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "Profiler.h"
+#include <cstdio>
+
+std::atomic<size_t> profileCounters[PROFILE_NUM_COUNTERS];
+
+const char* profileCounterName(ProfileCounter counter) {
+    static const char* names[PROFILE_NUM_COUNTERS] = {
+        "field_queries", "bvh_nodes_visited", "triangles_tested", "active_cells"
+    };
+    return names[counter];
+}
+
+void Profile::addTime(const std::string& stage, double seconds) {
+    for (auto& entry : stageTimes) {
+        if (entry.first == stage) {
+            entry.second += seconds;
+            return;
+        }
+    }
+    stageTimes.emplace_back(stage, seconds);
+}
+
+double Profile::seconds(const std::string& stage) const {
+    for (const auto& entry : stageTimes) {
+        if (entry.first == stage) return entry.second;
+    }
+    return 0.0;
+}
+
+double Profile::totalSeconds() const {
+    double total = 0.0;
+    for (const auto& entry : stageTimes) total += entry.second;
+    return total;
+}
+
+std::string Profile::summary() const {
+    std::string text;
+    char buffer[64];
+    for (const auto& entry : stageTimes) {
+        std::snprintf(buffer, sizeof(buffer), "%s%s %.3f s", text.empty() ? "" : ", ", entry.first.c_str(), entry.second);
+        text += buffer;
+    }
+    for (int c = 0; c < PROFILE_NUM_COUNTERS; ++c) {
+        std::snprintf(buffer, sizeof(buffer), "%s%s %zu", c == 0 ? " | " : ", ", profileCounterName((ProfileCounter)c), counts[c]);
+        text += buffer;
+    }
+    return text;
+}
+
+std::string Profile::toJson() const {
+    std::string json = "{\"stages\": {";
+    char buffer[64];
+    for (size_t i = 0; i < stageTimes.size(); ++i) {
+        std::snprintf(buffer, sizeof(buffer), "%s\"%s\": %.6f", i > 0 ? ", " : "", stageTimes[i].first.c_str(), stageTimes[i].second);
+        json += buffer;
+    }
+    json += "}, \"counters\": {";
+    for (int c = 0; c < PROFILE_NUM_COUNTERS; ++c) {
+        std::snprintf(buffer, sizeof(buffer), "%s\"%s\": %zu", c > 0 ? ", " : "", profileCounterName((ProfileCounter)c), counts[c]);
+        json += buffer;
+    }
+    json += "}}";
+    return json;
+}
+
+ScopedTimer::ScopedTimer(Profile* profile_, const char* stage_)
+    : profile(profile_), stage(stage_)
+{
+    if (!profile) return;
+    for (int c = 0; c < PROFILE_NUM_COUNTERS; ++c) {
+        startCounts[c] = profileCounters[c].load(std::memory_order_relaxed);
+    }
+    TIMER_START();
+}
+
+void ScopedTimer::stop() {
+    if (!profile) return;
+    TIMER_END();
+    profile->addTime(stage, TIMER_DURATION);
+    for (int c = 0; c < PROFILE_NUM_COUNTERS; ++c) {
+        profile->addCount((ProfileCounter)c, profileCounters[c].load(std::memory_order_relaxed) - startCounts[c]);
+    }
+    profile = nullptr;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+
+// Work counters bumped from the hot paths. They are process wide and relaxed, so
+// bump them once per query or cell rather than once per triangle.
+enum ProfileCounter {
+    PROFILE_FIELD_QUERIES,
+    PROFILE_BVH_NODES_VISITED,
+    PROFILE_TRIANGLES_TESTED,
+    PROFILE_ACTIVE_CELLS,       // cells that produced mesh geometry
+    PROFILE_NUM_COUNTERS
+};
+
+extern std::atomic<size_t> profileCounters[PROFILE_NUM_COUNTERS];
+
+inline void profileCount(ProfileCounter counter, size_t n = 1) {
+    profileCounters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+const char* profileCounterName(ProfileCounter counter);
+
+// Stage timings and counter totals of one meshing pass
+class Profile {
+public:
+    // Stages keep the order they were first timed in; timing one again adds up
+    void addTime(const std::string& stage, double seconds);
+    void addCount(ProfileCounter counter, size_t n) { counts[counter] += n; }
+
+    double seconds(const std::string& stage) const;
+    size_t count(ProfileCounter counter) const { return counts[counter]; }
+    double totalSeconds() const;
+
+    const std::vector<std::pair<std::string, double>>& stages() const { return stageTimes; }
+
+    // "band 0.005 s, sampling 0.706 s | field_queries 117515, ..."
+    std::string summary() const;
+    // {"stages": {...}, "counters": {...}}
+    std::string toJson() const;
+
+private:
+    std::vector<std::pair<std::string, double>> stageTimes;
+    size_t counts[PROFILE_NUM_COUNTERS] = {};
+};
+
+// Adds the lifetime of the scope, or the time until stop(), to a stage of profile
+// along with whatever the counters gathered meanwhile. Stages should not nest or
+// the counts add up twice. Does nothing when profile is null.
+class ScopedTimer {
+public:
+    ScopedTimer(Profile* profile, const char* stage);
+    ~ScopedTimer() { stop(); }
+
+    void stop();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    TIMER_INIT()
+    Profile* profile;
+    const char* stage;
+    size_t startCounts[PROFILE_NUM_COUNTERS];
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+
+// Dense 3D grid of field samples in one contiguous, aligned allocation.
+// X is the fastest axis; rows are padded so every row starts on a SIMD boundary.
+// Resizing keeps the allocation, so a grid can be reused across meshing passes.
+class ScalarGrid {
+public:
+    // Row padding in samples (32 bytes of doubles)
+    static const int ROW_ALIGN = 4;
+
+    // Sample counts per axis
+    void resize(int nx, int ny, int nz) {
+        sizeX = nx;
+        sizeY = ny;
+        sizeZ = nz;
+        rowStride = (nx + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+        sliceStride = rowStride * static_cast<size_t>(ny);
+        values.resize(sliceStride * nz);
+    }
+
+    void fill(Real value) { std::fill(values.begin(), values.end(), value); }
+
+    int nx() const { return sizeX; }
+    int ny() const { return sizeY; }
+    int nz() const { return sizeZ; }
+    size_t strideY() const { return rowStride; }
+    size_t strideZ() const { return sliceStride; }
+
+    size_t index(int i, int j, int k) const { return i + rowStride * j + sliceStride * k; }
+    Real& at(int i, int j, int k) { return values[index(i, j, k)]; }
+    Real at(int i, int j, int k) const { return values[index(i, j, k)]; }
+
+    // View of the z = k slab, sample (i, j) lives at slice(k)[i + j * strideY()]
+    Real* slice(int k) { return values.data() + sliceStride * k; }
+    const Real* slice(int k) const { return values.data() + sliceStride * k; }
+
+    Real* data() { return values.data(); }
+    const Real* data() const { return values.data(); }
+    size_t memoryBytes() const { return values.capacity() * sizeof(Real); }
+
+private:
+    int sizeX = 0, sizeY = 0, sizeZ = 0;
+    size_t rowStride = 0;
+    size_t sliceStride = 0;
+    std::vector<Real, Eigen::aligned_allocator<Real>> values;
+};
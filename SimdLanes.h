@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Quaternion/SETTINGS.h"
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Thin wrappers over one register of Reals, so branch free kernels are written
+// once: SIMD_LANES Reals per instruction, 8 with AVX-512, 4 with AVX, 2 with SSE2,
+// 1 otherwise, picked by the instruction set the including file is compiled for,
+// and twice as many in single precision.
+// SIMD(_mm_add_) names the double (pd) or single precision (ps) intrinsic.
+#ifdef MASSGEN_SINGLE_PRECISION
+#define SIMD_SUFFIX ps
+#else
+#define SIMD_SUFFIX pd
+#endif
+#define SIMD_PASTE(op, suffix) op##suffix
+#define SIMD_NAME(op, suffix) SIMD_PASTE(op, suffix)
+#define SIMD(op) SIMD_NAME(op, SIMD_SUFFIX)
+
+#if defined(__AVX512F__)
+
+#define SIMD_LANES (64 / (int)sizeof(Real))
+struct Lanes {
+#ifdef MASSGEN_SINGLE_PRECISION
+    __m512 v;
+#else
+    __m512d v;
+#endif
+    static Lanes load(const Real* p) { return { SIMD(_mm512_loadu_)(p) }; }
+    static Lanes set(Real x) { return { SIMD(_mm512_set1_)(x) }; }
+    void store(Real* p) const { SIMD(_mm512_storeu_)(p, v); }
+};
+// One bit per lane
+struct LaneMask {
+#ifdef MASSGEN_SINGLE_PRECISION
+    __mmask16 m;
+#else
+    __mmask8 m;
+#endif
+};
+inline Lanes operator+(Lanes a, Lanes b) { return { SIMD(_mm512_add_)(a.v, b.v) }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { SIMD(_mm512_sub_)(a.v, b.v) }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { SIMD(_mm512_mul_)(a.v, b.v) }; }
+// Masked with every lane set: GCC 12 warns -Wmaybe-uninitialized on the undefined
+// source register of the plain _mm512_min / _mm512_max
+inline Lanes lanesMin(Lanes a, Lanes b) { return { SIMD(_mm512_mask_min_)(a.v, decltype(LaneMask::m)(~0), a.v, b.v) }; }
+inline Lanes lanesMax(Lanes a, Lanes b) { return { SIMD(_mm512_mask_max_)(a.v, decltype(LaneMask::m)(~0), a.v, b.v) }; }
+inline LaneMask lessEqual(Lanes a, Lanes b) { return { SIMD_NAME(SIMD(_mm512_cmp_), _mask)(a.v, b.v, _CMP_LE_OQ) }; }
+inline LaneMask operator&(LaneMask a, LaneMask b) { return { decltype(a.m)(a.m & b.m) }; }
+inline bool anyLane(LaneMask a) { return a.m != 0; }
+// a in the lanes of mask, else b
+inline Lanes select(LaneMask mask, Lanes a, Lanes b) { return { SIMD(_mm512_mask_blend_)(mask.m, b.v, a.v) }; }
+
+#elif defined(__AVX__)
+
+#define SIMD_LANES (32 / (int)sizeof(Real))
+struct Lanes {
+#ifdef MASSGEN_SINGLE_PRECISION
+    __m256 v;
+#else
+    __m256d v;
+#endif
+    static Lanes load(const Real* p) { return { SIMD(_mm256_loadu_)(p) }; }
+    static Lanes set(Real x) { return { SIMD(_mm256_set1_)(x) }; }
+    void store(Real* p) const { SIMD(_mm256_storeu_)(p, v); }
+};
+// All bits set in the lanes where the comparison holds
+struct LaneMask {
+    Lanes bits;
+};
+inline Lanes operator+(Lanes a, Lanes b) { return { SIMD(_mm256_add_)(a.v, b.v) }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { SIMD(_mm256_sub_)(a.v, b.v) }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { SIMD(_mm256_mul_)(a.v, b.v) }; }
+inline Lanes lanesMin(Lanes a, Lanes b) { return { SIMD(_mm256_min_)(a.v, b.v) }; }
+inline Lanes lanesMax(Lanes a, Lanes b) { return { SIMD(_mm256_max_)(a.v, b.v) }; }
+inline LaneMask lessEqual(Lanes a, Lanes b) { return { { SIMD(_mm256_cmp_)(a.v, b.v, _CMP_LE_OQ) } }; }
+inline LaneMask operator&(LaneMask a, LaneMask b) { return { { SIMD(_mm256_and_)(a.bits.v, b.bits.v) } }; }
+inline bool anyLane(LaneMask a) { return SIMD(_mm256_movemask_)(a.bits.v) != 0; }
+inline Lanes select(LaneMask mask, Lanes a, Lanes b) { return { SIMD(_mm256_blendv_)(b.v, a.v, mask.bits.v) }; }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#define SIMD_LANES (16 / (int)sizeof(Real))
+struct Lanes {
+#ifdef MASSGEN_SINGLE_PRECISION
+    __m128 v;
+#else
+    __m128d v;
+#endif
+    static Lanes load(const Real* p) { return { SIMD(_mm_loadu_)(p) }; }
+    static Lanes set(Real x) { return { SIMD(_mm_set1_)(x) }; }
+    void store(Real* p) const { SIMD(_mm_storeu_)(p, v); }
+};
+struct LaneMask {
+    Lanes bits;
+};
+inline Lanes operator+(Lanes a, Lanes b) { return { SIMD(_mm_add_)(a.v, b.v) }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { SIMD(_mm_sub_)(a.v, b.v) }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { SIMD(_mm_mul_)(a.v, b.v) }; }
+inline Lanes lanesMin(Lanes a, Lanes b) { return { SIMD(_mm_min_)(a.v, b.v) }; }
+inline Lanes lanesMax(Lanes a, Lanes b) { return { SIMD(_mm_max_)(a.v, b.v) }; }
+inline LaneMask lessEqual(Lanes a, Lanes b) { return { { SIMD(_mm_cmple_)(a.v, b.v) } }; }
+inline LaneMask operator&(LaneMask a, LaneMask b) { return { { SIMD(_mm_and_)(a.bits.v, b.bits.v) } }; }
+inline bool anyLane(LaneMask a) { return SIMD(_mm_movemask_)(a.bits.v) != 0; }
+inline Lanes select(LaneMask mask, Lanes a, Lanes b) {
+    // No blend before SSE4.1: and / andnot / or
+    return { SIMD(_mm_or_)(SIMD(_mm_and_)(mask.bits.v, a.v), SIMD(_mm_andnot_)(mask.bits.v, b.v)) };
+}
+
+#else
+
+#define SIMD_LANES 1
+struct Lanes {
+    Real v;
+    static Lanes load(const Real* p) { return { *p }; }
+    static Lanes set(Real x) { return { x }; }
+    void store(Real* p) const { *p = v; }
+};
+struct LaneMask {
+    bool m;
+};
+inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+inline Lanes lanesMin(Lanes a, Lanes b) { return { std::min(a.v, b.v) }; }
+inline Lanes lanesMax(Lanes a, Lanes b) { return { std::max(a.v, b.v) }; }
+inline LaneMask lessEqual(Lanes a, Lanes b) { return { a.v <= b.v }; }
+inline LaneMask operator&(LaneMask a, LaneMask b) { return { a.m && b.m }; }
+inline bool anyLane(LaneMask a) { return a.m; }
+inline Lanes select(LaneMask mask, Lanes a, Lanes b) { return mask.m ? a : b; }
+
+#endif
@@ -0,0 +1,136 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+    if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0) numThreads = 1;
+
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (unsigned int i = 1; i < numThreads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobStart.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::popTask(unsigned int worker, size_t* task) {
+    // Own queue first, newest task
+    {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            *task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkQueue& victim = *queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::runTasks(unsigned int worker) {
+    size_t task;
+    while (popTask(worker, &task)) {
+        try {
+            (*job)(task);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (!jobError) jobError = std::current_exception();
+        }
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void ThreadPool::workerLoop(unsigned int worker) {
+    size_t seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobStart.wait(lock, [&] { return stopping || jobGeneration != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = jobGeneration;
+            activeWorkers++;
+        }
+
+        runTasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            activeWorkers--;
+        }
+        jobDone.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& body) {
+    if (begin >= end) return;
+
+    if (workers.empty()) {
+        for (size_t i = begin; i < end; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    // Publish the job before any task becomes visible, a worker still finishing
+    // the previous call may already pick them up
+    size_t count = end - begin;
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job = &body;
+        jobError = nullptr;
+        remaining.store(count, std::memory_order_release);
+    }
+
+    // Deal contiguous chunks so neighbouring tasks start on the same worker
+    size_t chunk = (count + queues.size() - 1) / queues.size();
+    for (size_t q = 0; q < queues.size(); ++q) {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        size_t first = std::min(end, begin + q * chunk);
+        size_t last = std::min(end, first + chunk);
+        // Reverse order so the owner pops its chunk front to back
+        for (size_t i = last; i > first; --i) {
+            queues[q]->tasks.push_back(i - 1);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobGeneration++;
+    }
+    jobStart.notify_all();
+
+    runTasks(0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        jobDone.wait(lock, [&] { return remaining.load(std::memory_order_acquire) == 0 && activeWorkers == 0; });
+        job = nullptr;
+        error = jobError;
+    }
+
+    if (error) std::rethrow_exception(error);
+}
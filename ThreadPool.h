@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads with per-worker task deques. Workers pop
+// from the back of their own deque and steal from the front of the others once
+// it runs dry, so uneven tasks (e.g. grid slabs near the surface) balance out.
+class ThreadPool {
+public:
+    // numThreads == 0 uses the hardware concurrency. The calling thread counts as
+    // one of the threads, so a pool of size 1 runs everything serially.
+    explicit ThreadPool(unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return static_cast<unsigned int>(queues.size()); }
+
+    // Runs body(i) for every i in [begin, end) and blocks until all have finished.
+    // The first exception thrown by a task is rethrown here.
+    void parallelFor(size_t begin, size_t end, const std::function<void(size_t)>& body);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void workerLoop(unsigned int worker);
+    bool popTask(unsigned int worker, size_t* task);
+    void runTasks(unsigned int worker);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;     // queues[0] belongs to the calling thread
+    std::vector<std::thread> workers;
+
+    std::mutex jobMutex;
+    std::condition_variable jobStart;
+    std::condition_variable jobDone;
+    const std::function<void(size_t)>* job = nullptr;
+    size_t jobGeneration = 0;
+    std::atomic<size_t> remaining{ 0 };
+    unsigned int activeWorkers = 0;
+    std::exception_ptr jobError;
+    bool stopping = false;
+};
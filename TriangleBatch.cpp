@@ -0,0 +1,105 @@
+#include "TriangleBatch.h"
+#include <algorithm>
+
+#include "SimdLanes.h"
+
+// Where every one of x, y, z is >= 0
+static inline LaneMask nonNegative(Lanes x, Lanes y, Lanes z) {
+    Lanes zero = Lanes::set(0.0);
+    return lessEqual(zero, x) & lessEqual(zero, y) & lessEqual(zero, z);
+}
+
+static Real reciprocalOrZero(Real x) {
+    return x > 0.0 ? 1.0 / x : 0.0;
+}
+
+void TriangleBatch::build(const std::vector<VEC3F>& vertices, const std::vector<uint>& indices, const std::vector<uint>& order) {
+    count = order.size();
+    // Room for a full batch read starting at the last triangle
+    stride = (count + 2 * SIMD_LANES - 1) / SIMD_LANES * SIMD_LANES;
+    data.assign(NUM_COMPONENTS * stride, 0.0);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint t = order[i];
+        const VEC3F& a = vertices[indices[3 * t]];
+        VEC3F ab = vertices[indices[3 * t + 1]] - a;
+        VEC3F ac = vertices[indices[3 * t + 2]] - a;
+        VEC3F n = ab.cross(ac);
+
+        // The dot products only serve the inside test. Degenerate triangles get
+        // 0, 0, 1 instead, for which the scaled barycentrics -d2, -d1 and
+        // d1 + d2 - 1 can never all be non negative, so they only use their edges.
+        bool degenerate = !(n.squaredNorm() > 0.0);
+        Real values[NUM_COMPONENTS] = {
+            a[0], a[1], a[2],
+            ab[0], ab[1], ab[2],
+            ac[0], ac[1], ac[2],
+            n[0], n[1], n[2],
+            degenerate ? Real(0) : ab.dot(ab), degenerate ? Real(0) : ac.dot(ac), degenerate ? Real(1) : ab.dot(ac),
+            reciprocalOrZero(ab.squaredNorm()), reciprocalOrZero(ac.squaredNorm()), reciprocalOrZero((ac - ab).squaredNorm()),
+            reciprocalOrZero(n.squaredNorm())
+        };
+        for (int c = 0; c < NUM_COMPONENTS; ++c) {
+            data[c * stride + i] = values[c];
+        }
+    }
+}
+
+void TriangleBatch::clear() {
+    count = 0;
+    stride = 0;
+    data.clear();
+}
+
+size_t TriangleBatch::memoryBytes() const {
+    return data.size() * sizeof(Real);
+}
+
+// Squared distance from p to the segment from the origin along e, given the
+// reciprocal squared length of e
+static inline Lanes segmentDistance2(Lanes px, Lanes py, Lanes pz, Lanes ex, Lanes ey, Lanes ez, Lanes invLength2) {
+    Lanes t = (px * ex + py * ey + pz * ez) * invLength2;
+    t = lanesMin(lanesMax(t, Lanes::set(0.0)), Lanes::set(1.0));
+    Lanes dx = px - t * ex;
+    Lanes dy = py - t * ey;
+    Lanes dz = pz - t * ez;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+void TriangleBatch::distances2(const VEC3F& p, size_t start, size_t n, Real* out) const {
+    const Lanes px = Lanes::set(p[0]), py = Lanes::set(p[1]), pz = Lanes::set(p[2]);
+    auto component = [&](int c, size_t i) { return Lanes::load(&data[c * stride + i]); };
+
+    for (size_t i = start; i < start + n; i += SIMD_LANES) {
+        Lanes abx = component(ABX, i), aby = component(ABY, i), abz = component(ABZ, i);
+        Lanes acx = component(ACX, i), acy = component(ACY, i), acz = component(ACZ, i);
+        Lanes apx = px - component(AX, i), apy = py - component(AY, i), apz = pz - component(AZ, i);
+
+        // The projection of p is inside the triangle where its barycentric
+        // coordinates, scaled by |n|^2, are all non negative (Ericson 5.1.5)
+        Lanes d1 = abx * apx + aby * apy + abz * apz;
+        Lanes d2 = acx * apx + acy * apy + acz * apz;
+        Lanes abab = component(AB_AB, i), acac = component(AC_AC, i), abac = component(AB_AC, i);
+        Lanes vb = acac * d1 - abac * d2;
+        Lanes vc = abab * d2 - abac * d1;
+        Lanes va = (abab * acac - abac * abac) - vb - vc;
+        Lanes invN = component(INV_N, i);
+        Lanes np = component(NX, i) * apx + component(NY, i) * apy + component(NZ, i) * apz;
+        Lanes face = np * np * invN;
+
+        // Otherwise the closest point is on one of the edges
+        Lanes edges = lanesMin(segmentDistance2(apx, apy, apz, abx, aby, abz, component(INV_AB, i)),
+                               segmentDistance2(apx, apy, apz, acx, acy, acz, component(INV_AC, i)));
+        edges = lanesMin(edges, segmentDistance2(apx - abx, apy - aby, apz - abz,
+                                                 acx - abx, acy - aby, acz - abz, component(INV_BC, i)));
+
+        Lanes result = select(nonNegative(va, vb, vc), face, edges);
+        if (i + SIMD_LANES <= start + n) {
+            result.store(out + (i - start));
+        } else {
+            Real tail[SIMD_LANES];
+            result.store(tail);
+            std::copy(tail, tail + (start + n - i), out + (i - start));
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+
+// Triangles in structure of arrays layout for distance queries against several
+// triangles at once. The kernel is branch free and runs SIMD_LANES triangles per
+// instruction (see SimdLanes.h).
+class TriangleBatch {
+public:
+    // Triangles indices[3 * order[i]..] in the order given, so a BVH leaf that is
+    // a range of order is a range of the batch
+    void build(const std::vector<VEC3F>& vertices, const std::vector<uint>& indices, const std::vector<uint>& order);
+    void clear();
+
+    size_t size() const { return count; }
+    size_t memoryBytes() const;
+
+    // Squared distances from p to triangles [start, start + n) into out
+    void distances2(const VEC3F& p, size_t start, size_t n, Real* out) const;
+
+private:
+    enum Component {
+        AX, AY, AZ,             // corner a
+        ABX, ABY, ABZ,          // edge b - a
+        ACX, ACY, ACZ,          // edge c - a
+        NX, NY, NZ,             // ab x ac
+        AB_AB, AC_AC, AB_AC,    // edge dot products, see build for degenerate triangles
+        INV_AB, INV_AC, INV_BC, // reciprocal squared edge lengths, 0 for degenerate edges
+        INV_N,                  // reciprocal |n|^2, 0 for degenerate triangles
+        NUM_COMPONENTS
+    };
+
+    size_t count = 0;
+    size_t stride = 0;          // count plus room for reading a whole batch past the last triangle
+    std::vector<Real> data;     // component c of triangle i at c * stride + i
+};
@@ -0,0 +1,126 @@
+#include "VersorGrid.h"
+#include <algorithm>
+#include <cmath>
+
+// Points the baked channels are checked against exact evaluation on
+#define VERSOR_GRID_TEST_POINTS 1024
+
+// Catmull-Rom weights of the samples at -1, 0, 1 and 2 for a point at t in [0, 1)
+static inline void catmullRomWeights(Real t, Real w[4]) {
+    w[0] = 0.5 * t * ((2.0 - t) * t - 1.0);
+    w[1] = 0.5 * ((3.0 * t - 5.0) * t * t + 2.0);
+    w[2] = 0.5 * t * ((4.0 - 3.0 * t) * t + 1.0);
+    w[3] = 0.5 * (t - 1.0) * t * t;
+}
+
+bool VersorGrid::bake(const Versor& versor, const VEC3F& minBox, const VEC3F& maxBox, Real tolerance, size_t maxSamples, ThreadPool& pool) {
+    values.clear();
+    maxError = 0.0;
+    if (versor.octave == 0 || !(versor.scale > 0.0)) return false;
+
+    // Fixed pseudo random test points, the same for every bake of the box
+    std::vector<VEC3F> testPoints(VERSOR_GRID_TEST_POINTS), exact(VERSOR_GRID_TEST_POINTS);
+    unsigned int seed = 12345u;
+    auto random01 = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (Real)(1u << 24);
+    };
+    for (VEC3F& point : testPoints) {
+        VEC3F t(random01(), random01(), random01());
+        point = minBox + t.cwiseProduct(maxBox - minBox);
+    }
+    versor.getChannelValues(testPoints.data(), exact.data(), testPoints.size());
+
+    // Starts from two samples per lattice cell of the first octave. Every octave
+    // halves the cell but also the amplitude, so a fine octave may not need its
+    // cells resolved to meet the tolerance.
+    const Real cell = 1.0 / versor.scale;
+    const VEC3F extent = maxBox - minBox;
+    for (Real step = 0.5 * cell; ; step *= 0.5) {
+        // The cubic stencil reaches one sample below and two above the cell of a
+        // point, so the box is padded by two samples on each side
+        int counts[3];
+        double total = 1.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            counts[axis] = (int)std::ceil(extent[axis] / step) + 5;
+            total *= counts[axis];
+        }
+        if (total > (double)maxSamples) {
+            values.clear();
+            return false;
+        }
+
+        h = step;
+        invH = 1.0 / step;
+        nx = counts[0];
+        ny = counts[1];
+        nz = counts[2];
+        origin = minBox - VEC3F(2.0 * step, 2.0 * step, 2.0 * step);
+        values.resize((size_t)nx * ny * nz);
+
+        pool.parallelFor(0, nz, [&](size_t k) {
+            std::vector<VEC3F> row(nx);
+            for (int j = 0; j < ny; ++j) {
+                for (int i = 0; i < nx; ++i) {
+                    row[i] = origin + h * VEC3F(i, j, (Real)k);
+                }
+                versor.getChannelValues(row.data(), row.data(), nx);
+                Eigen::Vector3f* out = &values[(size_t)nx * (j + (size_t)ny * k)];
+                for (int i = 0; i < nx; ++i) {
+                    out[i] = row[i].cast<float>();
+                }
+            }
+        });
+
+        maxError = 0.0;
+        for (size_t p = 0; p < testPoints.size(); ++p) {
+            maxError = std::max(maxError, (channels(testPoints[p]) - exact[p]).cwiseAbs().maxCoeff());
+        }
+        if (maxError <= tolerance) return true;
+
+        // The cubic error falls by at most 8 per halving, once every octave is
+        // resolved. Give up now rather than after baking grids that could not get
+        // within tolerance even at that rate.
+        int halvings = (int)std::ceil(std::log(maxError / tolerance) / std::log(8.0));
+        if (total * std::pow(8.0, halvings) > (double)maxSamples) {
+            values.clear();
+            return false;
+        }
+    }
+}
+
+bool VersorGrid::contains(const VEC3F& pos) const {
+    if (values.empty()) return false;
+    VEC3F local = (pos - origin) * invH;
+    return local[0] >= 1.0 && local[0] < nx - 2.0
+        && local[1] >= 1.0 && local[1] < ny - 2.0
+        && local[2] >= 1.0 && local[2] < nz - 2.0;
+}
+
+VEC3F VersorGrid::channels(const VEC3F& pos) const {
+    VEC3F local = (pos - origin) * invH;
+    int base[3];
+    Real w[3][4];
+    for (int axis = 0; axis < 3; ++axis) {
+        Real cellStart = std::floor(local[axis]);
+        base[axis] = (int)cellStart - 1;
+        catmullRomWeights(local[axis] - cellStart, w[axis]);
+    }
+
+    VEC3F result = VEC3F::Zero();
+    for (int c = 0; c < 4; ++c) {
+        VEC3F plane = VEC3F::Zero();
+        for (int b = 0; b < 4; ++b) {
+            const Eigen::Vector3f* row = &values[base[0] + (size_t)nx * ((base[1] + b) + (size_t)ny * (base[2] + c))];
+            VEC3F line = w[0][0] * row[0].cast<Real>() + w[0][1] * row[1].cast<Real>()
+                       + w[0][2] * row[2].cast<Real>() + w[0][3] * row[3].cast<Real>();
+            plane += w[1][b] * line;
+        }
+        result += w[2][c] * plane;
+    }
+    return result;
+}
+
+VEC3F VersorGrid::getFieldValue(const VEC3F& pos) const {
+    return channels(pos).normalized();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "Quaternion/SETTINGS.h"
+#include "ThreadPool.h"
+#include "VersorMap.h"
+
+// Versor channels baked onto a regular grid over a box of noise space and read
+// back with tricubic (Catmull-Rom) interpolation, so the noise costs the same few
+// dozen multiply-adds whatever its octave count. The interpolated channels are
+// normalised like Versor's, so the result is a unit vector as well.
+class VersorGrid {
+public:
+    // Samples the versor over the box, starting from two samples per cell of its
+    // first octave and halving the spacing until the channels differ from exact
+    // evaluation by at most tolerance on a fixed set of test points. Returns false,
+    // leaving the grid empty, if that would take more than maxSamples samples.
+    bool bake(const Versor& versor, const VEC3F& minBox, const VEC3F& maxBox, Real tolerance, size_t maxSamples, ThreadPool& pool);
+
+    bool empty() const { return values.empty(); }
+
+    // True if pos is far enough inside the box for the full interpolation stencil
+    bool contains(const VEC3F& pos) const;
+
+    // Unit noise direction at pos, which must be contained
+    VEC3F getFieldValue(const VEC3F& pos) const;
+
+    Real spacing() const { return h; }
+    Real measuredError() const { return maxError; }
+    size_t memoryBytes() const { return values.size() * sizeof(Eigen::Vector3f); }
+
+private:
+    VEC3F channels(const VEC3F& pos) const;
+
+    VEC3F origin = VEC3F::Zero();   // position of sample (0, 0, 0)
+    Real h = 0.0;                   // sample spacing
+    Real invH = 0.0;
+    int nx = 0, ny = 0, nz = 0;     // samples per axis
+    // Channels of sample (i, j, k) at i + nx * (j + ny * k). Single precision is far
+    // below any useful tolerance and halves the memory traffic of a lookup.
+    std::vector<Eigen::Vector3f> values;
+    Real maxError = 0.0;
+};
@@ -1,16 +1,237 @@
 #include "VersorMap.h"
+#include <algorithm>
+#include <cstdint>
+
+// Points per batch. The per-lane loops below have no dependencies between lanes,
+// so the compiler vectorises everything but the permutation table lookups; a
+// single point runs them once.
+#define VERSOR_LANES 8
+
+// Octave noise persistence, the siv::PerlinNoise default
+#define VERSOR_PERSISTENCE 0.5
+
+// siv::perlin_detail::Grad as dot products, indexed by the low four hash bits.
+// Grad picks one of these edge directions through data dependent branches, which
+// random sample points mispredict; the lookup has none and gives the same values.
+static const Real gradients[16][3] = {
+    { 1.0,  1.0,  0.0},
+    {-1.0,  1.0,  0.0},
+    { 1.0, -1.0,  0.0},
+    {-1.0, -1.0,  0.0},
+    { 1.0,  0.0,  1.0},
+    {-1.0,  0.0,  1.0},
+    { 1.0,  0.0, -1.0},
+    {-1.0,  0.0, -1.0},
+    { 0.0,  1.0,  1.0},
+    { 0.0, -1.0,  1.0},
+    { 0.0,  1.0, -1.0},
+    { 0.0, -1.0, -1.0},
+    { 1.0,  1.0,  0.0},
+    { 0.0, -1.0,  1.0},
+    {-1.0,  1.0,  0.0},
+    { 0.0, -1.0, -1.0},
+};
+
+static inline Real gradient(std::uint8_t hash, Real x, Real y, Real z) {
+    const Real* g = gradients[hash & 15];
+    return g[0] * x + g[1] * y + g[2] * z;
+}
 
 VEC3F Versor::getFieldValue(const VEC3F& pos) const {
-    
-    VEC3F p = pos * scale;
+    VEC3F value;
+    getFieldValues(&pos, &value, 1);
+    return value;
+}
+
+void Versor::getFieldValues(const VEC3F* pos, VEC3F* out, size_t count) const {
+    getChannelValues(pos, out, count);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = out[i].normalized();
+    }
+}
+
+void Versor::getChannelValues(const VEC3F* pos, VEC3F* out, size_t count) const {
+    using namespace siv::perlin_detail;
+    const siv::PerlinNoise::state_type* permutations[3] = { &nx.serialize(), &ny.serialize(), &nz.serialize() };
+
+    for (size_t start = 0; start < count; start += VERSOR_LANES) {
+        const size_t lanes = std::min<size_t>(VERSOR_LANES, count - start);
+
+        // Same steps as siv::PerlinNoise::octave3D_01 for every channel, in the same
+        // order, so the values match calling it three times
+        Real x[VERSOR_LANES], y[VERSOR_LANES], z[VERSOR_LANES];
+        Real sum[3][VERSOR_LANES] = {};
+        for (size_t l = 0; l < lanes; ++l) {
+            const VEC3F& p = pos[start + l];
+            x[l] = p[0] * scale;
+            y[l] = p[1] * scale;
+            z[l] = p[2] * scale;
+        }
+
+        Real amplitude = 1.0;
+        for (unsigned int o = 0; o < octave; ++o) {
+            // Lattice cell and fade weights, shared by the three channels
+            Real fx[VERSOR_LANES], fy[VERSOR_LANES], fz[VERSOR_LANES];
+            Real u[VERSOR_LANES], v[VERSOR_LANES], w[VERSOR_LANES];
+            std::int32_t ix[VERSOR_LANES], iy[VERSOR_LANES], iz[VERSOR_LANES];
+            for (size_t l = 0; l < lanes; ++l) {
+                Real cx = std::floor(x[l]), cy = std::floor(y[l]), cz = std::floor(z[l]);
+                ix[l] = static_cast<std::int32_t>(cx) & 255;
+                iy[l] = static_cast<std::int32_t>(cy) & 255;
+                iz[l] = static_cast<std::int32_t>(cz) & 255;
+                fx[l] = x[l] - cx;
+                fy[l] = y[l] - cy;
+                fz[l] = z[l] - cz;
+                u[l] = Fade(fx[l]);
+                v[l] = Fade(fy[l]);
+                w[l] = Fade(fz[l]);
+            }
+
+            for (int channel = 0; channel < 3; ++channel) {
+                const siv::PerlinNoise::state_type& perm = *permutations[channel];
+
+                // Gradient hashes of the eight cell corners
+                std::uint8_t hash[8][VERSOR_LANES];
+                for (size_t l = 0; l < lanes; ++l) {
+                    const std::uint8_t A = (perm[ix[l]] + iy[l]) & 255;
+                    const std::uint8_t B = (perm[(ix[l] + 1) & 255] + iy[l]) & 255;
+                    const std::uint8_t AA = (perm[A] + iz[l]) & 255;
+                    const std::uint8_t AB = (perm[(A + 1) & 255] + iz[l]) & 255;
+                    const std::uint8_t BA = (perm[B] + iz[l]) & 255;
+                    const std::uint8_t BB = (perm[(B + 1) & 255] + iz[l]) & 255;
+                    hash[0][l] = perm[AA];
+                    hash[1][l] = perm[BA];
+                    hash[2][l] = perm[AB];
+                    hash[3][l] = perm[BB];
+                    hash[4][l] = perm[(AA + 1) & 255];
+                    hash[5][l] = perm[(BA + 1) & 255];
+                    hash[6][l] = perm[(AB + 1) & 255];
+                    hash[7][l] = perm[(BB + 1) & 255];
+                }
+
+                for (size_t l = 0; l < lanes; ++l) {
+                    const Real x0 = fx[l], y0 = fy[l], z0 = fz[l];
+                    const Real q0 = Lerp(gradient(hash[0][l], x0, y0, z0), gradient(hash[1][l], x0 - 1, y0, z0), u[l]);
+                    const Real q1 = Lerp(gradient(hash[2][l], x0, y0 - 1, z0), gradient(hash[3][l], x0 - 1, y0 - 1, z0), u[l]);
+                    const Real q2 = Lerp(gradient(hash[4][l], x0, y0, z0 - 1), gradient(hash[5][l], x0 - 1, y0, z0 - 1), u[l]);
+                    const Real q3 = Lerp(gradient(hash[6][l], x0, y0 - 1, z0 - 1), gradient(hash[7][l], x0 - 1, y0 - 1, z0 - 1), u[l]);
+                    const Real r0 = Lerp(q0, q1, v[l]);
+                    const Real r1 = Lerp(q2, q3, v[l]);
+                    sum[channel][l] += Lerp(r0, r1, w[l]) * amplitude;
+                }
+            }
+
+            for (size_t l = 0; l < lanes; ++l) {
+                x[l] *= 2;
+                y[l] *= 2;
+                z[l] *= 2;
+            }
+            amplitude *= VERSOR_PERSISTENCE;
+        }
+
+        for (size_t l = 0; l < lanes; ++l) {
+            out[start + l] = VEC3F(
+                RemapClamp_01(sum[0][l]) * 2.0 - 1.0,
+                RemapClamp_01(sum[1][l]) * 2.0 - 1.0,
+                RemapClamp_01(sum[2][l]) * 2.0 - 1.0
+            );
+        }
+    }
+}
+
+// Lerp of two values and their gradients by t = Fade(f), f the lattice fraction
+// along axis; dt is the derivative of the fade at f
+static inline Real lerpWithGradient(Real a, const VEC3F& da, Real b, const VEC3F& db, Real t, Real dt, int axis, VEC3F* gradient) {
+    *gradient = da + (db - da) * t;
+    (*gradient)[axis] += (b - a) * dt;
+    return siv::perlin_detail::Lerp(a, b, t);
+}
+
+// Derivative of siv::perlin_detail::Fade
+static inline Real fadeDerivative(Real t) {
+    return 30.0 * t * t * (t - 1.0) * (t - 1.0);
+}
+
+VEC3F Versor::getFieldValueAndJacobian(const VEC3F& pos, Matrix<Real, 3, 3>* jacobian) const {
+    using namespace siv::perlin_detail;
+    const siv::PerlinNoise::state_type* permutations[3] = { &nx.serialize(), &ny.serialize(), &nz.serialize() };
+
+    // Same steps as getChannelValues for one point, carrying the gradient of every
+    // intermediate value along. Row c of channelJacobian is the gradient of channel c.
+    Real x = pos[0] * scale, y = pos[1] * scale, z = pos[2] * scale;
+    Real sum[3] = {};
+    Matrix<Real, 3, 3> channelJacobian = Matrix<Real, 3, 3>::Zero();
+    Real amplitude = 1.0;
+    Real frequency = scale;
+    for (unsigned int o = 0; o < octave; ++o) {
+        const Real cx = std::floor(x), cy = std::floor(y), cz = std::floor(z);
+        const std::int32_t ix = static_cast<std::int32_t>(cx) & 255;
+        const std::int32_t iy = static_cast<std::int32_t>(cy) & 255;
+        const std::int32_t iz = static_cast<std::int32_t>(cz) & 255;
+        const Real fx = x - cx, fy = y - cy, fz = z - cz;
+        const Real u = Fade(fx), v = Fade(fy), w = Fade(fz);
+        const Real du = fadeDerivative(fx), dv = fadeDerivative(fy), dw = fadeDerivative(fz);
+
+        for (int channel = 0; channel < 3; ++channel) {
+            const siv::PerlinNoise::state_type& perm = *permutations[channel];
+            const std::uint8_t A = (perm[ix] + iy) & 255;
+            const std::uint8_t B = (perm[(ix + 1) & 255] + iy) & 255;
+            const std::uint8_t AA = (perm[A] + iz) & 255;
+            const std::uint8_t AB = (perm[(A + 1) & 255] + iz) & 255;
+            const std::uint8_t BA = (perm[B] + iz) & 255;
+            const std::uint8_t BB = (perm[(B + 1) & 255] + iz) & 255;
+            const std::uint8_t hash[8] = {
+                perm[AA], perm[BA], perm[AB], perm[BB],
+                perm[(AA + 1) & 255], perm[(BA + 1) & 255], perm[(AB + 1) & 255], perm[(BB + 1) & 255]
+            };
+
+            // Corner c contributes its gradient direction dotted with the offset from
+            // the corner, so its own gradient is that direction
+            Real corner[8];
+            VEC3F cornerGradient[8];
+            for (int c = 0; c < 8; ++c) {
+                const Real* g = gradients[hash[c] & 15];
+                corner[c] = gradient(hash[c], fx - (c & 1), fy - ((c >> 1) & 1), fz - ((c >> 2) & 1));
+                cornerGradient[c] = VEC3F(g[0], g[1], g[2]);
+            }
+
+            VEC3F dq[4], dr[2], dn;
+            Real q[4], r[2];
+            for (int e = 0; e < 4; ++e) {
+                q[e] = lerpWithGradient(corner[2 * e], cornerGradient[2 * e], corner[2 * e + 1], cornerGradient[2 * e + 1], u, du, 0, &dq[e]);
+            }
+            r[0] = lerpWithGradient(q[0], dq[0], q[1], dq[1], v, dv, 1, &dr[0]);
+            r[1] = lerpWithGradient(q[2], dq[2], q[3], dq[3], v, dv, 1, &dr[1]);
+            Real n = lerpWithGradient(r[0], dr[0], r[1], dr[1], w, dw, 2, &dn);
+
+            sum[channel] += n * amplitude;
+            // Lattice coordinates are pos times the octave's frequency
+            channelJacobian.row(channel) += (amplitude * frequency) * dn.transpose();
+        }
+
+        x *= 2;
+        y *= 2;
+        z *= 2;
+        frequency *= 2;
+        amplitude *= VERSOR_PERSISTENCE;
+    }
 
-    VEC3F v(
-        nx.octave3D_01(p.x(), p.y(), p.z(), octave) * 2.0 - 1.0,
-        ny.octave3D_01(p.x(), p.y(), p.z(), octave) * 2.0 - 1.0,
-        nz.octave3D_01(p.x(), p.y(), p.z(), octave) * 2.0 - 1.0
-    );
+    // The remap to [-1, 1] is the identity between its clamps, flat beyond them
+    VEC3F channels;
+    for (int c = 0; c < 3; ++c) {
+        channels[c] = RemapClamp_01(sum[c]) * 2.0 - 1.0;
+        if (sum[c] <= -1.0 || sum[c] >= 1.0) channelJacobian.row(c).setZero();
+    }
 
-    return v.normalized();
+    // Derivative of c / |c|: the part of dc orthogonal to the direction, over |c|
+    Real length = channels.norm();
+    VEC3F direction = channels.normalized();
+    if (length > 0.0) {
+        *jacobian = (Matrix<Real, 3, 3>::Identity() - direction * direction.transpose()) * channelJacobian / length;
+    } else {
+        jacobian->setZero();
+    }
+    return direction;
 }
 
 VEC3F Modulus::getFieldValue(const VEC3F& pos) const {
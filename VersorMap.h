@@ -10,13 +10,26 @@ public:
     unsigned int octave = 1u;
 
     Versor();
-    Versor(unsigned int seedNx, unsigned int seedNy, unsigned int seedNz, unsigned int octave_, double scale_): octave(octave_), scale(scale_) {
+    Versor(unsigned int seedNx, unsigned int seedNy, unsigned int seedNz, unsigned int octave_, double scale_): scale(scale_), octave(octave_) {
         nx.reseed(seedNx);
         ny.reseed(seedNy);
         nz.reseed(seedNz);
     }
     
+    // Unit noise direction at pos: every channel is octave Perlin noise mapped to [-1, 1]
     VEC3F getFieldValue(const VEC3F& pos) const;
+
+    // Batch version, same values; out may alias pos. The channels share the lattice
+    // cell and fade weights of every octave, and points go through in fixed width lanes.
+    void getFieldValues(const VEC3F* pos, VEC3F* out, size_t count) const;
+
+    // The three channels before normalising, each in [-1, 1]. Unlike the direction
+    // they are smooth everywhere, which is what VersorGrid interpolates.
+    void getChannelValues(const VEC3F* pos, VEC3F* out, size_t count) const;
+
+    // getFieldValue and its derivative, column a holding d direction / d pos[a],
+    // from the analytic derivatives of every octave in the same pass
+    VEC3F getFieldValueAndJacobian(const VEC3F& pos, Matrix<Real, 3, 3>* jacobian) const;
 };
 
 class Modulus {
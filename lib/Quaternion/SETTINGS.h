@@ -9,7 +9,13 @@
 
 using namespace Eigen;
 
+// MASSGEN_SINGLE_PRECISION runs the field pipeline in float: twice the SIMD lanes
+// and half the memory traffic, at about 1e-6 relative error
+#ifdef MASSGEN_SINGLE_PRECISION
+typedef float Real;
+#else
 typedef double Real;
+#endif
 typedef unsigned int uint;
 typedef Matrix<Real, 2, 1 > VEC2F;
 typedef Matrix<Real, 3, 1 > VEC3F;
@@ -1,8 +1,13 @@
 #pragma once
 
 #include "Quaternion/SETTINGS.h"
-#include <maya/MFnMesh.h>
-#include "PortalMap.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PointKdTree.h"
+
+class ThreadPool;
 
 // custom indexed mesh representation
 class Mesh {
@@ -10,17 +15,31 @@ public:
 	std::vector<VEC3F> vertices;
 	std::vector<VEC3F> normals;
 	std::vector<uint> indices;
-	MObject material;
 	VEC3F minVert;
 	VEC3F maxVert;
 
-	// Store original Maya mesh and UV set name for copying
-	MString uvSetName;
+	// Store original mesh and UV set for copying
+	std::string uvSetName;
 	std::vector<float> uvU, uvV;
 	std::vector<int> uvCountsVec, uvIdsVec;
 	std::vector<VEC3F> originalVertices;
-	
-	void fromMaya(const MFnMesh& mayaMesh);
-	MObject toMaya() const;
+	std::shared_ptr<const PointKdTree> originalIndex;	// over originalVertices, shared by fromMesh
+
+	// Recompute minVert and maxVert from the vertices
+	void computeBounds();
+
+	// Appends the vertices, normals and triangles of other
+	void append(const Mesh& other);
+
+	// Builds originalIndex; call again whenever originalVertices change
+	void indexOriginalVertices();
+
+	// Nearest original vertex of every vertex, spread over pool if given. Builds a
+	// temporary index if originalIndex is missing or stale.
+	void nearestOriginalVertices(std::vector<uint>* nearest, ThreadPool* pool = nullptr) const;
+
+	// UV of every vertex, taken from the nearest original vertex. Empty if no UVs were copied.
+	void transferUVs(std::vector<float>* u, std::vector<float>* v, ThreadPool* pool = nullptr) const;
+
     void fromMesh(const Mesh& other); // Helper to copy UV and original vertices
-};
\ No newline at end of file
+};